@@ -0,0 +1,249 @@
+#!/bin/bash
+
+# file_sync tests. The copy strategy chain is exercised on tmpfs (/dev/shm when it is one),
+# where FICLONE is unsupported, so every fallback step is reached. Set FILE_SYNC_TEST_DIR
+# to run them on another filesystem, e.g. a loop-mounted btrfs or XFS image.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+TESTS_PASSED=0
+TESTS_FAILED=0
+
+echo -e "${BLUE}=== file_sync Tester ===${NC}"
+echo ""
+
+print_result() {
+    if [ $1 -eq 0 ]; then
+        echo -e "${GREEN}✓ PASSED${NC}: $2"
+        ((TESTS_PASSED++))
+    else
+        echo -e "${RED}✗ FAILED${NC}: $2"
+        ((TESTS_FAILED++))
+    fi
+}
+
+# Scratch space: tmpfs unless told otherwise; the build goes there too, so the committed
+# binary is left alone
+if [ -n "$FILE_SYNC_TEST_DIR" ]; then
+    base="$FILE_SYNC_TEST_DIR"
+elif [ "$(stat -f -c %T /dev/shm 2>/dev/null)" = "tmpfs" ]; then
+    base=/dev/shm
+else
+    base=${TMPDIR:-/tmp}
+fi
+work=$(mktemp -d "$base/file_sync_test.XXXXXX")
+disk=$(mktemp -d "${TMPDIR:-/tmp}/file_sync_test.XXXXXX")
+fs_type=$(stat -f -c %T "$work")
+binary="$work/file_sync"
+echo "Testing on $fs_type ($work)"
+echo ""
+
+# Run file_sync from the scratch directory on src/ and dest/ there, replacing dest/ first
+sync_fresh() {
+    rm -rf "$work/dest"
+    (cd "$work" && "$binary" "$@" src dest) > "$work/output.txt" 2>&1
+}
+
+# Run file_sync again on the same src/ and dest/
+sync_again() {
+    (cd "$work" && "$binary" "$@" src dest) > "$work/output.txt" 2>&1
+}
+
+# The strategy printed for a file: the last parenthesized word of its "Copied:" line
+strategy_of() {
+    grep -E "^Copied: .*/$1 " "$work/output.txt" | sed -E 's/.*\(([a-z_]+)\)$/\1/'
+}
+
+# Test 1: Compilation
+echo -e "${YELLOW}Test 1: Compilation${NC}"
+if gcc -Wall -o "$binary" file_sync.c > "$work/build.txt" 2>&1; then
+    print_result 0 "file_sync.c compiles with gcc"
+else
+    print_result 1 "file_sync.c failed to compile: $(cat "$work/build.txt")"
+    rm -rf "$work" "$disk"
+    exit 1
+fi
+echo ""
+
+mkdir -p "$work/src"
+head -c 3000000 /dev/urandom > "$work/src/big"
+echo "small file" > "$work/src/small"
+: > "$work/src/empty"
+
+# Tests 2-5: each forced strategy, and where the chain falls back to. Without reflinks
+# (tmpfs, ext4) clone falls back to copy_file_range; elsewhere it depends on the filesystem.
+test_number=2
+for forced in clone copy_file_range sendfile read_write; do
+    echo -e "${YELLOW}Test $test_number: --copy-strategy=$forced${NC}"
+    expected=$forced
+    if [ "$forced" = "clone" ]; then
+        expected=$([ "$fs_type" = "tmpfs" ] && echo "copy_file_range" || echo "clone|copy_file_range")
+    fi
+    sync_fresh --copy-strategy=$forced
+    exit_code=$?
+    big=$(strategy_of big)
+    small=$(strategy_of small)
+    empty=$(strategy_of empty)
+    if [ $exit_code -eq 0 ] && [[ "$big" =~ ^($expected)$ ]] && [ "$small" = "$big" ] && [ "$empty" = "empty" ] &&
+       cmp -s "$work/src/big" "$work/dest/big" && cmp -s "$work/src/small" "$work/dest/small" &&
+       cmp -s "$work/src/empty" "$work/dest/empty"; then
+        print_result 0 "--copy-strategy=$forced copies with $big, the empty file reports empty"
+    else
+        print_result 1 "--copy-strategy=$forced (exit:$exit_code, big:'$big', small:'$small', empty:'$empty', expected:'$expected')"
+    fi
+    echo ""
+    ((test_number++))
+done
+
+# Test 6: Across filesystems copy_file_range may refuse with EXDEV and sendfile takes over
+echo -e "${YELLOW}Test 6: Copy Across Filesystems${NC}"
+if [ "$(stat -c %d "$work")" != "$(stat -c %d "$disk")" ]; then
+    rm -rf "$disk/dest"
+    (cd "$work" && "$binary" --copy-strategy=copy_file_range src "$disk/dest") > "$work/output.txt" 2>&1
+    exit_code=$?
+    big=$(strategy_of big)
+    if [ $exit_code -eq 0 ] && { [ "$big" = "sendfile" ] || [ "$big" = "copy_file_range" ]; } &&
+       cmp -s "$work/src/big" "$disk/dest/big"; then
+        print_result 0 "$fs_type to $(stat -f -c %T "$disk") copies with $big"
+    else
+        print_result 1 "Copy across filesystems (exit:$exit_code, big:'$big')"
+    fi
+else
+    print_result 0 "Skipped: $work and $disk are on the same filesystem"
+fi
+echo ""
+
+# Test 7: Unknown strategy
+echo -e "${YELLOW}Test 7: Unknown Strategy${NC}"
+sync_fresh --copy-strategy=bogus
+exit_code=$?
+if [ $exit_code -eq 1 ] && grep -q "^Usage: file_sync" "$work/output.txt" && [ ! -d "$work/dest" ]; then
+    print_result 0 "An unknown strategy prints the usage and exits with 1"
+else
+    print_result 1 "Unknown strategy accepted (exit:$exit_code)"
+fi
+echo ""
+
+# Tests 8-11: --delta patches a large file in place. Each starts from an up-to-date copy
+# with an old mtime, edits the source (giving it the current mtime) and syncs again.
+head -c 3000000 /dev/urandom > "$work/delta_base"
+delta_case() {
+    local name=$1 edit=$2 max_written=$3
+    echo -e "${YELLOW}Test $test_number: --delta, $name${NC}"
+    rm -rf "$work/src"
+    mkdir -p "$work/src"
+    cp "$work/delta_base" "$work/src/delta"
+    touch -d @1000000000 "$work/src/delta"
+    sync_fresh
+    eval "$edit"
+    sync_again --delta
+    exit_code=$?
+    written=$(grep -E "^Patched: .*/delta " "$work/output.txt" | sed -E 's/.*\(([0-9]+) of [0-9]+ bytes rewritten\)$/\1/')
+    if [ $exit_code -eq 0 ] && [ -n "$written" ] && [ "$written" -le "$max_written" ] &&
+       cmp -s "$work/src/delta" "$work/dest/delta"; then
+        print_result 0 "$name: patched with $written bytes rewritten, files match"
+    else
+        print_result 1 "$name (exit:$exit_code, written:'$written', at most $max_written expected)"
+    fi
+    echo ""
+    ((test_number++))
+}
+test_number=8
+delta_case "patch in the middle" \
+    'printf "MIDDLE" | dd of="$work/src/delta" bs=1 seek=1500000 conv=notrunc status=none' 6
+delta_case "append" 'head -c 5000 /dev/urandom >> "$work/src/delta"' 5000
+delta_case "truncate" 'truncate -s 2000000 "$work/src/delta"' 0
+delta_case "change in the first chunk" \
+    'printf "FIRST" | dd of="$work/src/delta" bs=1 seek=10 conv=notrunc status=none' 5
+
+# Tests 12-14: the manifest in the destination root
+rm -rf "$work/src"
+mkdir -p "$work/src/sub"
+echo "first file" > "$work/src/one"
+echo "second file" > "$work/src/two"
+echo "not ours" > "$work/src/sub/.file_sync_manifest"
+
+echo -e "${YELLOW}Test 12: Manifest, Second Run${NC}"
+sync_fresh
+sync_again
+exit_code=$?
+identical=$(grep -c "is identical. Skipping" "$work/output.txt")
+if [ $exit_code -eq 0 ] && [ "$identical" -eq 3 ] && ! grep -q "^Copied:" "$work/output.txt" &&
+   head -n 1 "$work/dest/.file_sync_manifest" | grep -q "^file_sync manifest"; then
+    print_result 0 "A second run reports all 3 files identical and copies nothing"
+else
+    print_result 1 "Second run (exit:$exit_code, identical:$identical/3)"
+fi
+echo ""
+
+echo -e "${YELLOW}Test 13: Manifest, Changed Files${NC}"
+# Same sizes, new contents: neither side matches what the manifest recorded any more
+echo "FIRST FILE" > "$work/src/one"
+echo "SECOND FILE" > "$work/dest/two"
+sync_again
+exit_code=$?
+if [ $exit_code -eq 0 ] && grep -q "^File one is newer in source. Updating" "$work/output.txt" &&
+   grep -q "^File two is newer in destination. Skipping" "$work/output.txt" &&
+   cmp -s "$work/src/one" "$work/dest/one"; then
+    print_result 0 "A changed source is copied and a changed destination is compared again"
+else
+    print_result 1 "Changed files were not compared again (exit:$exit_code)"
+fi
+echo ""
+
+echo -e "${YELLOW}Test 14: Manifest Name in a Subdirectory${NC}"
+if [ -f "$work/dest/sub/.file_sync_manifest" ] &&
+   cmp -s "$work/src/sub/.file_sync_manifest" "$work/dest/sub/.file_sync_manifest"; then
+    print_result 0 "sub/.file_sync_manifest is synced like any other file"
+else
+    print_result 1 "sub/.file_sync_manifest was not synced"
+fi
+echo ""
+
+# Test 15: A nested tree synced by one worker and by eight gives the same files and output
+echo -e "${YELLOW}Test 15: -j 1 and -j 8 on a Nested Tree${NC}"
+rm -rf "$work/src" "$work/dest1" "$work/dest8"
+for dir in . a a/b a/b/c d e/f; do
+    mkdir -p "$work/src/$dir"
+    for i in $(seq 1 20); do
+        head -c $((RANDOM * 3)) /dev/urandom > "$work/src/$dir/file$i"
+    done
+done
+(cd "$work" && "$binary" -j 1 src dest1) > "$work/output1.txt" 2>&1
+exit1=$?
+(cd "$work" && "$binary" -j 8 src dest8) > "$work/output8.txt" 2>&1
+exit8=$?
+# The manifests record inode numbers, so only they may differ between the two trees
+if [ $exit1 -eq 0 ] && [ $exit8 -eq 0 ] &&
+   diff -r --exclude=.file_sync_manifest "$work/src" "$work/dest1" > /dev/null &&
+   diff -r --exclude=.file_sync_manifest "$work/dest1" "$work/dest8" > /dev/null &&
+   diff <(sed "s/\bdest1\b/DEST/g" "$work/output1.txt") \
+        <(sed "s/\bdest8\b/DEST/g" "$work/output8.txt") > /dev/null; then
+    print_result 0 "-j 1 and -j 8 copy the same $(grep -c "^Copied:" "$work/output8.txt") files with the same output"
+else
+    print_result 1 "-j 1 and -j 8 differ (exit:$exit1/$exit8)"
+fi
+echo ""
+
+# Summary
+echo -e "${BLUE}=== Test Summary ===${NC}"
+echo -e "Tests Passed: ${GREEN}$TESTS_PASSED${NC}"
+echo -e "Tests Failed: ${RED}$TESTS_FAILED${NC}"
+echo -e "Total Tests: $((TESTS_PASSED + TESTS_FAILED))"
+
+if [ $TESTS_FAILED -eq 0 ]; then
+    echo -e "${GREEN}All tests passed! 🎉${NC}"
+else
+    echo -e "${RED}Some tests failed. Check the output above for details.${NC}"
+fi
+
+# Cleanup
+echo ""
+echo -e "${YELLOW}Cleaning up test files...${NC}"
+rm -rf "$work" "$disk"
+
+exit $TESTS_FAILED
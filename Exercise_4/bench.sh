@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Pipeline benchmark sweep: runs ex3.out --stats over a grid of configurations and prints
+# one JSON object per run (throughput, p50/p99/p999 latency, per-stage queue occupancy).
+# Story lines go to /dev/null so the console is not what gets measured.
+#
+# Override the grid with environment variables, e.g.
+#   BENCH_PRODUCERS="1 8" BENCH_EDIT_US="0" ./bench.sh > results.jsonl
+
+PRODUCERS=${BENCH_PRODUCERS:-"1 4 10"}
+QUEUE_SIZES=${BENCH_QUEUE_SIZES:-"1 16 128"}
+EDIT_US=${BENCH_EDIT_US:-"0 20"}
+COEDITORS=${BENCH_COEDITORS:-"1"}
+MESSAGES=${BENCH_MESSAGES:-20000}   # total per run, split evenly across producers
+BINARY=${BENCH_BINARY:-./ex3.out}
+
+if [ ! -x "$BINARY" ]; then
+    echo "bench.sh: $BINARY not found, run make first" >&2
+    exit 1
+fi
+
+config=$(mktemp)
+trap 'rm -f "$config"' EXIT
+
+for producers in $PRODUCERS; do
+    for queue_size in $QUEUE_SIZES; do
+        for edit_us in $EDIT_US; do
+            for coeditors in $COEDITORS; do
+                : > "$config"
+                per_producer=$((MESSAGES / producers))
+                for ((i = 1; i <= producers; i++)); do
+                    printf "PRODUCER %d\n%d\nqueue size = %d\n\n" "$i" "$per_producer" "$queue_size" >> "$config"
+                done
+                printf "Co-Editors per category = %d\nEdit time = %d\n\nCo-Editor queue size = %d\n" \
+                    "$coeditors" "$edit_us" "$queue_size" >> "$config"
+
+                # The JSON line arrives on stderr; stories are discarded
+                if ! "$BINARY" "$config" --stats 2>&1 >/dev/null; then
+                    echo "bench.sh: run failed (producers=$producers queue=$queue_size edit=$edit_us)" >&2
+                    exit 1
+                fi
+            done
+        done
+    done
+done
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "bounded_buffer.h"
+
+// Measures producer -> dispatcher handoff latency with bursty producers, comparing the
+// old 1 ms polling dispatcher against one that sleeps on a BufferNotifier.
+//
+// Usage: bench_dispatch.out [producers] [messages per producer] [queue size] [burst gap us]
+
+typedef enum {
+    MODE_POLL = 0,
+    MODE_NOTIFY = 1
+} DispatchMode;
+
+const char* modeNames[] = {"poll", "notify"};
+
+typedef struct {
+    long long sentNs;
+} Stamp;
+
+typedef struct {
+    int id;
+    int numMessages;
+    int burstGapUs;
+    BoundedBuffer* queue;
+    Stamp* stamps;
+} BenchProducer;
+
+int numProducers = 4;
+int messagesPerProducer = 2000;
+int queueSize = 16;
+int burstGapUs = 500;
+
+BoundedBuffer** queues;
+BufferNotifier notifier;
+DispatchMode mode;
+long long* latencies;
+double dispatcherCpuMs;
+
+static long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void* benchProducer(void* arg) {
+    BenchProducer* data = (BenchProducer*)arg;
+    unsigned int seed = (unsigned int)data->id * 2654435761u;
+
+    int sent = 0;
+    while (sent < data->numMessages) {
+        // Send a burst of 1-4 messages, then go quiet for up to twice the gap
+        int burst = 1 + rand_r(&seed) % 4;
+        for (int b = 0; b < burst && sent < data->numMessages; b++, sent++) {
+            data->stamps[sent].sentNs = nowNs();
+            insertOwned(data->queue, &data->stamps[sent]);
+        }
+        usleep(rand_r(&seed) % (2 * data->burstGapUs + 1));
+    }
+    return NULL;
+}
+
+void* benchDispatcher(void* arg) {
+    (void)arg;
+    int total = numProducers * messagesPerProducer;
+    int received = 0;
+    int round = 0;
+    int waiting = 0;
+    unsigned int key = 0;
+
+    while (received < total) {
+        int foundMessage = 0;
+        for (int i = 0; i < numProducers; i++) {
+            Stamp* stamp = tryRemoveItem(queues[(round + i) % numProducers]);
+            if (stamp) {
+                latencies[received++] = nowNs() - stamp->sentNs;
+                foundMessage = 1;
+            }
+        }
+        round++;
+
+        if (mode == MODE_POLL) {
+            if (!foundMessage) {
+                usleep(1000);
+            }
+        } else if (foundMessage || received >= total) {
+            if (waiting) {
+                cancelNotifierWait(&notifier);
+                waiting = 0;
+            }
+        } else if (!waiting) {
+            key = prepareNotifierWait(&notifier);
+            waiting = 1;
+        } else {
+            commitNotifierWait(&notifier, key);
+            waiting = 0;
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    dispatcherCpuMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+                      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+    return NULL;
+}
+
+int compareLongLong(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+void runBenchmark(DispatchMode benchMode) {
+    int total = numProducers * messagesPerProducer;
+    mode = benchMode;
+    latencies = (long long*)malloc(total * sizeof(long long));
+    queues = (BoundedBuffer**)malloc(numProducers * sizeof(BoundedBuffer*));
+    BenchProducer* producers = (BenchProducer*)malloc(numProducers * sizeof(BenchProducer));
+    pthread_t* producerThreads = (pthread_t*)malloc(numProducers * sizeof(pthread_t));
+    pthread_t dispatcherThread;
+
+    initBufferNotifier(&notifier);
+    for (int i = 0; i < numProducers; i++) {
+        queues[i] = createBoundedBuffer(queueSize, BB_SPSC);
+        if (mode == MODE_NOTIFY) {
+            setBufferNotifier(queues[i], &notifier);
+        }
+        producers[i].id = i + 1;
+        producers[i].numMessages = messagesPerProducer;
+        producers[i].burstGapUs = burstGapUs;
+        producers[i].queue = queues[i];
+        producers[i].stamps = (Stamp*)malloc(messagesPerProducer * sizeof(Stamp));
+    }
+
+    long long start = nowNs();
+    pthread_create(&dispatcherThread, NULL, benchDispatcher, NULL);
+    for (int i = 0; i < numProducers; i++) {
+        pthread_create(&producerThreads[i], NULL, benchProducer, &producers[i]);
+    }
+    for (int i = 0; i < numProducers; i++) {
+        pthread_join(producerThreads[i], NULL);
+    }
+    pthread_join(dispatcherThread, NULL);
+    double elapsedMs = (nowNs() - start) / 1e6;
+
+    qsort(latencies, total, sizeof(long long), compareLongLong);
+    printf("mode=%s producers=%d messages=%d queue_size=%d burst_gap_us=%d "
+           "p50_us=%.1f p99_us=%.1f max_us=%.1f dispatcher_cpu_ms=%.1f elapsed_ms=%.1f\n",
+           modeNames[mode], numProducers, total, queueSize, burstGapUs,
+           latencies[total / 2] / 1e3, latencies[(int)(total * 0.99)] / 1e3,
+           latencies[total - 1] / 1e3, dispatcherCpuMs, elapsedMs);
+
+    for (int i = 0; i < numProducers; i++) {
+        destroyBoundedBuffer(queues[i]);
+        free(producers[i].stamps);
+    }
+    destroyBufferNotifier(&notifier);
+    free(producerThreads);
+    free(producers);
+    free(queues);
+    free(latencies);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) numProducers = atoi(argv[1]);
+    if (argc > 2) messagesPerProducer = atoi(argv[2]);
+    if (argc > 3) queueSize = atoi(argv[3]);
+    if (argc > 4) burstGapUs = atoi(argv[4]);
+
+    if (numProducers < 1 || messagesPerProducer < 1 || queueSize < 1 || burstGapUs < 0) {
+        printf("Usage: %s [producers] [messages per producer] [queue size] [burst gap us]\n", argv[0]);
+        return 1;
+    }
+
+    runBenchmark(MODE_POLL);
+    runBenchmark(MODE_NOTIFY);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "bounded_buffer.h"
+
+// Measures the co-editor queue fan-in: several writers that pause between messages, like
+// co-editors editing, and one reader, like the screen manager. Every wait policy is run in
+// turn on the locked and the MPMC queue to show handoff latency and throughput against the
+// CPU time burnt while waiting. A gap of 0 makes the writers flood the queue.
+//
+// Usage: bench_fanin.out [writers] [messages per writer] [queue size] [gap us] [spin limit]
+
+typedef struct {
+    long long sentNs;
+} Stamp;
+
+typedef struct {
+    int id;
+    BoundedBuffer* queue;
+    Stamp* stamps;
+} BenchWriter;
+
+int numWriters = 3;
+int messagesPerWriter = 5000;
+int queueSize = 8;
+int gapUs = 50;
+int spinLimit = DEFAULT_SPIN_LIMIT;
+
+long long* latencies;
+double readerCpuMs;
+
+static long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double cpuMs(int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+void* benchWriter(void* arg) {
+    BenchWriter* data = (BenchWriter*)arg;
+    unsigned int seed = (unsigned int)data->id * 2654435761u;
+
+    for (int i = 0; i < messagesPerWriter; i++) {
+        // "Edit" for up to twice the gap, then hand the message on
+        if (gapUs > 0) {
+            usleep(rand_r(&seed) % (2 * gapUs + 1));
+        }
+        data->stamps[i].sentNs = nowNs();
+        insertOwned(data->queue, &data->stamps[i]);
+    }
+    return NULL;
+}
+
+void* benchReader(void* arg) {
+    BoundedBuffer* queue = (BoundedBuffer*)arg;
+    int total = numWriters * messagesPerWriter;
+
+    for (int received = 0; received < total; received++) {
+        Stamp* stamp = removeItem(queue);
+        latencies[received] = nowNs() - stamp->sentNs;
+    }
+    readerCpuMs = cpuMs(RUSAGE_THREAD);
+    return NULL;
+}
+
+int compareLongLong(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+void runBenchmark(BufferMode mode, WaitPolicy policy) {
+    int total = numWriters * messagesPerWriter;
+    latencies = (long long*)malloc(total * sizeof(long long));
+    BenchWriter* writers = (BenchWriter*)malloc(numWriters * sizeof(BenchWriter));
+    pthread_t* writerThreads = (pthread_t*)malloc(numWriters * sizeof(pthread_t));
+    pthread_t readerThread;
+
+    BoundedBuffer* queue = createBoundedBuffer(queueSize, mode);
+    setBufferWaitPolicy(queue, policy, spinLimit);
+    for (int i = 0; i < numWriters; i++) {
+        writers[i].id = i + 1;
+        writers[i].queue = queue;
+        writers[i].stamps = (Stamp*)malloc(messagesPerWriter * sizeof(Stamp));
+    }
+
+    double cpuStart = cpuMs(RUSAGE_SELF);
+    long long start = nowNs();
+    pthread_create(&readerThread, NULL, benchReader, queue);
+    for (int i = 0; i < numWriters; i++) {
+        pthread_create(&writerThreads[i], NULL, benchWriter, &writers[i]);
+    }
+    for (int i = 0; i < numWriters; i++) {
+        pthread_join(writerThreads[i], NULL);
+    }
+    pthread_join(readerThread, NULL);
+    double elapsedMs = (nowNs() - start) / 1e6;
+    double totalCpuMs = cpuMs(RUSAGE_SELF) - cpuStart;
+
+    qsort(latencies, total, sizeof(long long), compareLongLong);
+    printf("mode=%s wait=%s writers=%d messages=%d queue_size=%d gap_us=%d spin_limit=%d "
+           "p50_us=%.1f p99_us=%.1f max_us=%.1f msgs_per_sec=%.0f reader_cpu_ms=%.1f total_cpu_ms=%.1f elapsed_ms=%.1f\n",
+           bufferModeNames[mode], waitPolicyNames[policy], numWriters, total, queueSize, gapUs, spinLimit,
+           latencies[total / 2] / 1e3, latencies[(int)(total * 0.99)] / 1e3,
+           latencies[total - 1] / 1e3, total / (elapsedMs / 1e3), readerCpuMs, totalCpuMs, elapsedMs);
+
+    destroyBoundedBuffer(queue);
+    for (int i = 0; i < numWriters; i++) {
+        free(writers[i].stamps);
+    }
+    free(writerThreads);
+    free(writers);
+    free(latencies);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) numWriters = atoi(argv[1]);
+    if (argc > 2) messagesPerWriter = atoi(argv[2]);
+    if (argc > 3) queueSize = atoi(argv[3]);
+    if (argc > 4) gapUs = atoi(argv[4]);
+    if (argc > 5) spinLimit = atoi(argv[5]);
+
+    if (numWriters < 1 || messagesPerWriter < 1 || queueSize < 1 || gapUs < 0 || spinLimit < 0) {
+        printf("Usage: %s [writers] [messages per writer] [queue size] [gap us] [spin limit]\n", argv[0]);
+        return 1;
+    }
+
+    BufferMode modes[] = {BB_LOCKED, BB_MPMC};
+    for (int i = 0; i < 2; i++) {
+        runBenchmark(modes[i], BB_WAIT_BLOCK);
+        runBenchmark(modes[i], BB_WAIT_SPIN_THEN_BLOCK);
+        runBenchmark(modes[i], BB_WAIT_SPIN);
+    }
+    return 0;
+}
@@ -2,77 +2,774 @@
 #include "bounded_buffer.h"
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
+#include <time.h>
 
-BoundedBuffer* createBoundedBuffer(int size) {
-    BoundedBuffer* bb = (BoundedBuffer*)malloc(sizeof(BoundedBuffer));
-    bb->buffer = (char**)malloc(size * sizeof(char*));
+#define SPIN_LIMIT 128  // busy-wait iterations before yielding the CPU
+
+const char* bufferModeNames[] = {"locked", "spsc", "mpmc"};
+const char* waitPolicyNames[] = {"block", "spin-then-block", "spin"};
+
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+// Back off while an SPSC peer catches up: spin briefly, then give up the time slice
+static void backoff(int* spins) {
+    if (*spins < SPIN_LIMIT) {
+        cpuRelax();
+        (*spins)++;
+    } else {
+        sched_yield();
+    }
+}
+
+// Called after each failed attempt of a wait loop. Spins or yields as the buffer's policy
+// allows and returns 1 once the caller should go to sleep instead.
+static int shouldSleep(BoundedBuffer* bb, int* spins) {
+    if (bb->waitPolicy == BB_WAIT_SPIN) {
+        backoff(spins);
+        return 0;
+    }
+    if (bb->waitPolicy == BB_WAIT_SPIN_THEN_BLOCK && *spins < bb->spinLimit) {
+        cpuRelax();
+        (*spins)++;
+        return 0;
+    }
+    return 1;
+}
+
+static unsigned long nextPowerOfTwo(unsigned long n) {
+    unsigned long p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static long long monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Slot storage is written once here, so its pages are first touched, and on NUMA systems
+// placed, on the node of the thread creating the buffer
+static void* allocSlots(size_t bytes) {
+    void* slots = malloc(bytes);
+    if (slots) {
+        memset(slots, 0, bytes);
+    }
+    return slots;
+}
+
+BoundedBuffer* createBoundedBuffer(int size, BufferMode mode) {
+    BoundedBuffer* bb = NULL;
+    if (posix_memalign((void**)&bb, CACHE_LINE_SIZE, sizeof(BoundedBuffer)) != 0) {
+        return NULL;
+    }
+    memset(bb, 0, sizeof(BoundedBuffer));
     bb->size = size;
+    bb->mode = mode;
+    bb->waitPolicy = mode == BB_SPSC ? BB_WAIT_SPIN : BB_WAIT_BLOCK;
+    bb->spinLimit = DEFAULT_SPIN_LIMIT;
+    bb->openWriters = 1;
+
+    if (mode == BB_MPMC) {
+        bb->cells = (BufferCell*)allocSlots(size * sizeof(BufferCell));
+        for (int i = 0; i < size; i++) {
+            bb->cells[i].sequence = 2UL * i;
+            bb->cells[i].data = NULL;
+        }
+        // Readers and writers sleep on the ring's own notifier by default
+        setBufferWaitPolicy(bb, BB_WAIT_BLOCK, DEFAULT_SPIN_LIMIT);
+        return bb;
+    }
+
+    if (mode == BB_SPSC) {
+        bb->mask = nextPowerOfTwo(size) - 1;
+        bb->buffer = (void**)allocSlots((bb->mask + 1) * sizeof(void*));
+        return bb;
+    }
+
+    bb->buffer = (void**)allocSlots(size * sizeof(void*));
     bb->in = 0;
     bb->out = 0;
     bb->count = 0;
-    
+
     // Initialize semaphores
     sem_init(&bb->empty, 0, size);  // Initially all slots are empty
     sem_init(&bb->full, 0, 0);      // Initially no slots are full
     pthread_mutex_init(&bb->mutex, NULL);
-    
+
     return bb;
 }
 
-void insert(BoundedBuffer* bb, char* item) {
-    // Wait for empty slot
-    sem_wait(&bb->empty);
-    
-    // Enter critical section
+BufferMode chooseBufferMode(int writers, int readers) {
+    return writers == 1 && readers == 1 ? BB_SPSC : BB_MPMC;
+}
+
+// Wake threads blocked on a buffer's notifier. The fence orders the item or slot we just
+// published before the waiters load, pairing with the fence in prepareNotifierWait().
+static void notifyWaiters(BufferNotifier* n) {
+    if (!n) {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&n->waiters, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&n->mutex);
+        __atomic_store_n(&n->sequence, n->sequence + 1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&n->cond);
+        pthread_mutex_unlock(&n->mutex);
+    }
+}
+
+// Wake whoever waits for items: a dispatcher on the group notifier or a sleeping SPSC consumer
+static void notifyInserted(BoundedBuffer* bb) {
+    notifyWaiters(bb->notifier);
+    notifyWaiters(bb->peerNotifier);
+}
+
+// Wake whoever waits for free slots
+static void notifyRemoved(BoundedBuffer* bb) {
+    notifyWaiters(bb->spaceNotifier);
+    notifyWaiters(bb->peerNotifier);
+}
+
+// ---- Statistics hooks: each is a single NULL check when statistics are off ----
+
+static void lockBuffer(BoundedBuffer* bb) {
+    if (bb->stats && pthread_mutex_trylock(&bb->mutex) == 0) {
+        return;
+    }
+    if (bb->stats) {
+        __atomic_fetch_add(&bb->stats->lockContended, 1, __ATOMIC_RELAXED);
+    }
     pthread_mutex_lock(&bb->mutex);
-    
-    // Insert item
-    bb->buffer[bb->in] = strdup(item);
-    bb->in = (bb->in + 1) % bb->size;
-    bb->count++;
-    
+}
+
+static void recordEnqueue(BoundedBuffer* bb, int moved) {
+    BufferStats* stats = bb->stats;
+    if (!stats) {
+        return;
+    }
+    __atomic_fetch_add(&stats->enqueued, moved, __ATOMIC_RELAXED);
+    int occupancy = bufferCount(bb);
+    int high = __atomic_load_n(&stats->highWater, __ATOMIC_RELAXED);
+    while (occupancy > high &&
+           !__atomic_compare_exchange_n(&stats->highWater, &high, occupancy, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void recordDequeue(BoundedBuffer* bb, int moved) {
+    if (bb->stats && moved > 0) {
+        __atomic_fetch_add(&bb->stats->dequeued, moved, __ATOMIC_RELAXED);
+    }
+}
+
+static long long waitStart(BoundedBuffer* bb) {
+    return bb->stats ? monotonicNs() : 0;
+}
+
+// Account one blocking wait that started at 'start' (from waitStart)
+static void recordWait(BoundedBuffer* bb, long long start, int forSlot) {
+    BufferStats* stats = bb->stats;
+    if (!stats) {
+        return;
+    }
+    long long waited = monotonicNs() - start;
+    if (forSlot) {
+        __atomic_fetch_add(&stats->fullWaits, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->fullWaitNs, waited, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&stats->emptyWaits, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->emptyWaitNs, waited, __ATOMIC_RELAXED);
+    }
+}
+
+// ---- BB_SPSC ring: the producer owns tail, the consumer owns head ----
+
+// Queue up to n items into the free slots with a single release store; 0 when full
+static int spscTryInsertSome(BoundedBuffer* bb, void** items, int n) {
+    unsigned long tail = bb->tail;  // only this thread writes tail
+    unsigned long space = (unsigned long)bb->size - (tail - bb->cachedHead);
+
+    // Refresh our cached view of head only when the ring looks full
+    if (space == 0) {
+        bb->cachedHead = __atomic_load_n(&bb->head, __ATOMIC_ACQUIRE);
+        space = (unsigned long)bb->size - (tail - bb->cachedHead);
+        if (space == 0) {
+            return 0;
+        }
+    }
+
+    int moved = (unsigned long)n < space ? n : (int)space;
+    for (int i = 0; i < moved; i++) {
+        bb->buffer[(tail + i) & bb->mask] = items[i];
+    }
+    // Publish the slots: the release pairs with the consumer's acquire load of tail
+    __atomic_store_n(&bb->tail, tail + moved, __ATOMIC_RELEASE);
+    return moved;
+}
+
+static int spscTryRemoveSome(BoundedBuffer* bb, void** out, int max) {
+    unsigned long head = bb->head;  // only this thread writes head
+    unsigned long available = bb->cachedTail - head;
+
+    if (available == 0) {
+        bb->cachedTail = __atomic_load_n(&bb->tail, __ATOMIC_ACQUIRE);
+        available = bb->cachedTail - head;
+        if (available == 0) {
+            return 0;
+        }
+    }
+
+    int moved = (unsigned long)max < available ? max : (int)available;
+    for (int i = 0; i < moved; i++) {
+        out[i] = bb->buffer[(head + i) & bb->mask];
+    }
+    // Hand the slots back: the release pairs with the producer's acquire load of head
+    __atomic_store_n(&bb->head, head + moved, __ATOMIC_RELEASE);
+    return moved;
+}
+
+// ---- BB_MPMC ring (Vyukov): threads race for positions, the cell sequence hands them over ----
+
+static void recordContention(BoundedBuffer* bb) {
+    if (bb->stats) {
+        __atomic_fetch_add(&bb->stats->lockContended, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int mpmcTryInsert(BoundedBuffer* bb, void* item) {
+    unsigned long pos = __atomic_load_n(&bb->tail, __ATOMIC_RELAXED);
+    BufferCell* cell;
+
+    for (;;) {
+        cell = &bb->cells[pos % bb->size];
+        unsigned long sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long)(sequence - 2 * pos);
+        if (diff == 0) {
+            // The cell is free for this position: claim it (a failed CAS reloads pos)
+            if (__atomic_compare_exchange_n(&bb->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            recordContention(bb);
+        } else if (diff < 0) {
+            return 0;  // still holds the item from one lap ago: full
+        } else {
+            pos = __atomic_load_n(&bb->tail, __ATOMIC_RELAXED);  // another writer got here first
+        }
+    }
+
+    cell->data = item;
+    // Publish to readers: the release pairs with their acquire load of the sequence
+    __atomic_store_n(&cell->sequence, 2 * pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int mpmcTryRemove(BoundedBuffer* bb, void** out) {
+    unsigned long pos = __atomic_load_n(&bb->head, __ATOMIC_RELAXED);
+    BufferCell* cell;
+
+    for (;;) {
+        cell = &bb->cells[pos % bb->size];
+        unsigned long sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long)(sequence - (2 * pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&bb->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            recordContention(bb);
+        } else if (diff < 0) {
+            return 0;  // not written yet: empty
+        } else {
+            pos = __atomic_load_n(&bb->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    *out = cell->data;
+    // Hand the cell to the writer of the next lap
+    __atomic_store_n(&cell->sequence, 2 * (pos + bb->size), __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int mpmcTryInsertSome(BoundedBuffer* bb, void** items, int n) {
+    int moved = 0;
+    while (moved < n && mpmcTryInsert(bb, items[moved])) {
+        moved++;
+    }
+    return moved;
+}
+
+static int mpmcTryRemoveSome(BoundedBuffer* bb, void** out, int max) {
+    int moved = 0;
+    while (moved < max && mpmcTryRemove(bb, &out[moved])) {
+        moved++;
+    }
+    return moved;
+}
+
+// Non-blocking transfers on either ring
+static int ringTryInsertSome(BoundedBuffer* bb, void** items, int n) {
+    return bb->mode == BB_SPSC ? spscTryInsertSome(bb, items, n) : mpmcTryInsertSome(bb, items, n);
+}
+
+static int ringTryRemoveSome(BoundedBuffer* bb, void** out, int max) {
+    return bb->mode == BB_SPSC ? spscTryRemoveSome(bb, out, max) : mpmcTryRemoveSome(bb, out, max);
+}
+
+// ---- BB_LOCKED buffer: semaphores count slots, the mutex guards in/out ----
+
+// Store n items; the caller holds that many 'empty' tokens. Returns n, or 0 once closed.
+static int lockedPutSome(BoundedBuffer* bb, void** items, int n) {
+    // Enter critical section
+    lockBuffer(bb);
+
+    if (__atomic_load_n(&bb->closed, __ATOMIC_ACQUIRE)) {
+        // The tokens may include the one closing posted to wake writers: pass them on
+        pthread_mutex_unlock(&bb->mutex);
+        for (int i = 0; i < n; i++) {
+            sem_post(&bb->empty);
+        }
+        return 0;
+    }
+    for (int i = 0; i < n; i++) {
+        bb->buffer[bb->in] = items[i];
+        bb->in = (bb->in + 1) % bb->size;
+    }
+    bb->count += n;
+
     // Exit critical section
     pthread_mutex_unlock(&bb->mutex);
-    
-    // Signal that buffer has one more item
-    sem_post(&bb->full);
+
+    // Signal that buffer has n more items
+    for (int i = 0; i < n; i++) {
+        sem_post(&bb->full);
+    }
+    return n;
 }
 
-char* removeItem(BoundedBuffer* bb) {
-    // Wait for full slot
-    sem_wait(&bb->full);
-    
+// Take up to n items; the caller holds that many 'full' tokens. Only a closed buffer has
+// more tokens than items: the surplus one is handed on to wake the next reader, and 0
+// means end of stream.
+static int lockedTakeSome(BoundedBuffer* bb, void** out, int tokens) {
     // Enter critical section
-    pthread_mutex_lock(&bb->mutex);
-    
-    // Remove item
-    char* item = bb->buffer[bb->out];
-    bb->out = (bb->out + 1) % bb->size;
-    bb->count--;
-    
+    lockBuffer(bb);
+
+    int n = tokens < bb->count ? tokens : bb->count;
+    for (int i = 0; i < n; i++) {
+        out[i] = bb->buffer[bb->out];
+        bb->out = (bb->out + 1) % bb->size;
+    }
+    bb->count -= n;
+
     // Exit critical section
     pthread_mutex_unlock(&bb->mutex);
-    
-    // Signal that buffer has one more empty slot
-    sem_post(&bb->empty);
-    
-    return item;
+
+    for (int i = n; i < tokens; i++) {
+        sem_post(&bb->full);
+    }
+    // Signal that buffer has n more empty slots
+    for (int i = 0; i < n; i++) {
+        sem_post(&bb->empty);
+    }
+    return n;
+}
+
+// Claim up to max tokens from a semaphore without blocking
+static int claimTokens(sem_t* sem, int max) {
+    int claimed = 0;
+    while (claimed < max && sem_trywait(sem) == 0) {
+        claimed++;
+    }
+    return claimed;
+}
+
+// Take one token under the buffer's wait policy; the caller found the semaphore at zero
+static void waitToken(BoundedBuffer* bb, sem_t* sem) {
+    int spins = 0;
+    while (sem_trywait(sem) != 0) {
+        if (shouldSleep(bb, &spins)) {
+            sem_wait(sem);
+            return;
+        }
+    }
+}
+
+// ---- Blocking building blocks shared by the single-item and batch operations ----
+
+// Retry a ring transfer until it moves something or the buffer closes. A thread about to
+// sleep registers on the peer notifier and retries once more, so a transfer by the peer or
+// a close in between is never missed.
+static int ringWaitSome(BoundedBuffer* bb, void** items, int n, int forSlot) {
+    int spins = 0;
+    int registered = 0;
+    unsigned int key = 0;
+    int moved;
+
+    while ((moved = forSlot ? ringTryInsertSome(bb, items, n) : ringTryRemoveSome(bb, items, n)) == 0) {
+        if (isBufferClosed(bb)) {
+            // Every insert happened before the close: a reader takes what is left, if anything
+            moved = forSlot ? 0 : ringTryRemoveSome(bb, items, n);
+            break;
+        }
+        if (registered) {
+            commitNotifierWait(bb->peerNotifier, key);
+            registered = 0;
+        } else if (shouldSleep(bb, &spins)) {
+            key = prepareNotifierWait(bb->peerNotifier);
+            registered = 1;
+        }
+    }
+    if (registered) {
+        cancelNotifierWait(bb->peerNotifier);
+    }
+    return moved;
+}
+
+// Queue between 1 and n items, waiting while the buffer is full; 0 once it is closed
+static int waitInsertSome(BoundedBuffer* bb, void** items, int n) {
+    if (isBufferClosed(bb)) {
+        return 0;
+    }
+    if (bb->mode != BB_LOCKED) {
+        int moved = ringTryInsertSome(bb, items, n);
+        if (moved > 0) {
+            return moved;
+        }
+        long long start = waitStart(bb);
+        moved = ringWaitSome(bb, items, n, 1);
+        recordWait(bb, start, 1);
+        return moved;
+    }
+
+    // Wait for one empty slot, then claim as many more as are free right now
+    if (sem_trywait(&bb->empty) != 0) {
+        long long start = waitStart(bb);
+        waitToken(bb, &bb->empty);
+        recordWait(bb, start, 1);
+    }
+    int claimed = 1 + claimTokens(&bb->empty, n - 1);
+    return lockedPutSome(bb, items, claimed);
+}
+
+// Take between 1 and max items, waiting while the buffer is empty; 0 at end of stream
+static int waitRemoveSome(BoundedBuffer* bb, void** out, int max) {
+    if (bb->mode != BB_LOCKED) {
+        int moved = ringTryRemoveSome(bb, out, max);
+        if (moved > 0) {
+            return moved;
+        }
+        long long start = waitStart(bb);
+        moved = ringWaitSome(bb, out, max, 0);
+        recordWait(bb, start, 0);
+        return moved;
+    }
+
+    // Wait for one item, then take whatever else is already there
+    if (sem_trywait(&bb->full) != 0) {
+        long long start = waitStart(bb);
+        waitToken(bb, &bb->full);
+        recordWait(bb, start, 0);
+    }
+    int claimed = 1 + claimTokens(&bb->full, max - 1);
+    return lockedTakeSome(bb, out, claimed);
+}
+
+// ---- Public operations ----
+
+int insert(BoundedBuffer* bb, char* item) {
+    char* copy = strdup(item);
+    if (insertOwned(bb, copy)) {
+        return 1;
+    }
+    free(copy);
+    return 0;
+}
+
+int insertOwned(BoundedBuffer* bb, void* item) {
+    return insertBatch(bb, &item, 1);
+}
+
+void* removeItem(BoundedBuffer* bb) {
+    void* item;
+    return removeBatch(bb, &item, 1) == 1 ? item : NULL;
+}
+
+void* tryRemoveItem(BoundedBuffer* bb) {
+    void* item;
+    return tryRemoveBatch(bb, &item, 1) == 1 ? item : NULL;
+}
+
+int insertBatch(BoundedBuffer* bb, void** items, int n) {
+    int inserted = 0;
+
+    while (inserted < n) {
+        int moved = waitInsertSome(bb, items + inserted, n - inserted);
+        if (moved == 0) {
+            break;  // closed
+        }
+        inserted += moved;
+        recordEnqueue(bb, moved);
+        notifyInserted(bb);
+    }
+    return inserted;
+}
+
+int tryInsertOwned(BoundedBuffer* bb, void* item) {
+    return tryInsertBatch(bb, &item, 1);
+}
+
+int tryInsertBatch(BoundedBuffer* bb, void** items, int n) {
+    int moved;
+    if (isBufferClosed(bb)) {
+        return 0;
+    }
+    if (bb->mode != BB_LOCKED) {
+        moved = ringTryInsertSome(bb, items, n);
+    } else {
+        moved = claimTokens(&bb->empty, n);
+        if (moved > 0) {
+            moved = lockedPutSome(bb, items, moved);
+        }
+    }
+    if (moved > 0) {
+        recordEnqueue(bb, moved);
+        notifyInserted(bb);
+    }
+    return moved;
+}
+
+int removeBatch(BoundedBuffer* bb, void** out, int max) {
+    if (max <= 0) {
+        return 0;
+    }
+    int moved = waitRemoveSome(bb, out, max);
+    if (moved > 0) {
+        recordDequeue(bb, moved);
+        notifyRemoved(bb);
+    }
+    return moved;
+}
+
+int tryRemoveBatch(BoundedBuffer* bb, void** out, int max) {
+    int moved;
+    if (bb->mode != BB_LOCKED) {
+        moved = ringTryRemoveSome(bb, out, max);
+    } else {
+        moved = claimTokens(&bb->full, max);
+        if (moved > 0) {
+            moved = lockedTakeSome(bb, out, moved);
+        }
+    }
+    if (moved > 0) {
+        recordDequeue(bb, moved);
+        notifyRemoved(bb);
+    }
+    return moved;
+}
+
+void setBufferWriters(BoundedBuffer* bb, int writers) {
+    bb->openWriters = writers;
+}
+
+void closeBoundedBuffer(BoundedBuffer* bb) {
+    if (__atomic_sub_fetch(&bb->openWriters, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    __atomic_store_n(&bb->closed, 1, __ATOMIC_SEQ_CST);
+
+    // Wake every waiter. A semaphore sleeper gets one token that does not stand for an item
+    // or a slot; whoever takes it hands it on, so all of them wake in turn.
+    if (bb->mode == BB_LOCKED) {
+        sem_post(&bb->full);
+        sem_post(&bb->empty);
+    }
+    notifyInserted(bb);
+    notifyRemoved(bb);
+}
+
+int isBufferClosed(BoundedBuffer* bb) {
+    return __atomic_load_n(&bb->closed, __ATOMIC_ACQUIRE);
+}
+
+int isBufferDrained(BoundedBuffer* bb) {
+    if (!isBufferClosed(bb)) {
+        return 0;
+    }
+    if (bb->mode != BB_LOCKED) {
+        return bufferCount(bb) == 0;
+    }
+    // The semaphore may hold the wake-up token, so look at the items themselves
+    pthread_mutex_lock(&bb->mutex);
+    int empty = bb->count == 0;
+    pthread_mutex_unlock(&bb->mutex);
+    return empty;
+}
+
+int bufferCount(BoundedBuffer* bb) {
+    if (bb->mode != BB_LOCKED) {
+        // MPMC positions are claimed before their cells are filled or emptied, so clamp
+        unsigned long head = __atomic_load_n(&bb->head, __ATOMIC_ACQUIRE);
+        unsigned long tail = __atomic_load_n(&bb->tail, __ATOMIC_ACQUIRE);
+        if (tail <= head) {
+            return 0;
+        }
+        return tail - head < (unsigned long)bb->size ? (int)(tail - head) : bb->size;
+    }
+
+    int value = 0;
+    sem_getvalue(&bb->full, &value);
+    return value > 0 ? value : 0;
 }
 
 void destroyBoundedBuffer(BoundedBuffer* bb) {
     if (bb) {
         // Clean up any remaining items
-        for (int i = 0; i < bb->count; i++) {
-            int index = (bb->out + i) % bb->size;
-            if (bb->buffer[index]) {
-                free(bb->buffer[index]);
+        if (bb->mode == BB_SPSC) {
+            for (unsigned long i = bb->head; i != bb->tail; i++) {
+                free(bb->buffer[i & bb->mask]);
             }
+        } else if (bb->mode == BB_MPMC) {
+            for (unsigned long i = bb->head; i != bb->tail; i++) {
+                free(bb->cells[i % bb->size].data);
+            }
+            free(bb->cells);
+        } else {
+            for (int i = 0; i < bb->count; i++) {
+                int index = (bb->out + i) % bb->size;
+                if (bb->buffer[index]) {
+                    free(bb->buffer[index]);
+                }
+            }
+            sem_destroy(&bb->empty);
+            sem_destroy(&bb->full);
+            pthread_mutex_destroy(&bb->mutex);
+        }
+
+        if (bb->peerNotifier) {
+            destroyBufferNotifier(bb->peerNotifier);
+            free(bb->peerNotifier);
         }
-        
+        free(bb->stats);
         free(bb->buffer);
-        sem_destroy(&bb->empty);
-        sem_destroy(&bb->full);
-        pthread_mutex_destroy(&bb->mutex);
         free(bb);
     }
-}
\ No newline at end of file
+}
+
+void initBufferNotifier(BufferNotifier* n) {
+    n->sequence = 0;
+    n->waiters = 0;
+    pthread_mutex_init(&n->mutex, NULL);
+    pthread_cond_init(&n->cond, NULL);
+}
+
+void destroyBufferNotifier(BufferNotifier* n) {
+    pthread_mutex_destroy(&n->mutex);
+    pthread_cond_destroy(&n->cond);
+}
+
+void setBufferNotifier(BoundedBuffer* bb, BufferNotifier* n) {
+    bb->notifier = n;
+}
+
+void setBufferSpaceNotifier(BoundedBuffer* bb, BufferNotifier* n) {
+    bb->spaceNotifier = n;
+}
+
+int setBufferWaitPolicy(BoundedBuffer* bb, WaitPolicy policy, int spinLimit) {
+    // A ring's threads can only sleep if the other side knows to wake them
+    if (bb->mode != BB_LOCKED && policy != BB_WAIT_SPIN && !bb->peerNotifier) {
+        BufferNotifier* n = (BufferNotifier*)malloc(sizeof(BufferNotifier));
+        if (!n) {
+            return -1;
+        }
+        initBufferNotifier(n);
+        bb->peerNotifier = n;
+    }
+    bb->waitPolicy = policy;
+    bb->spinLimit = spinLimit >= 0 ? spinLimit : DEFAULT_SPIN_LIMIT;
+    return 0;
+}
+
+int parseWaitPolicy(const char* name, WaitPolicy* policy) {
+    for (int i = BB_WAIT_BLOCK; i <= BB_WAIT_SPIN; i++) {
+        if (strcmp(name, waitPolicyNames[i]) == 0) {
+            *policy = (WaitPolicy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+unsigned int prepareNotifierWait(BufferNotifier* n) {
+    unsigned int key = __atomic_load_n(&n->sequence, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&n->waiters, 1, __ATOMIC_SEQ_CST);
+    // Order the registration before the caller re-checks its buffers (see notifyWaiters)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return key;
+}
+
+void commitNotifierWait(BufferNotifier* n, unsigned int key) {
+    pthread_mutex_lock(&n->mutex);
+    while (__atomic_load_n(&n->sequence, __ATOMIC_ACQUIRE) == key) {
+        pthread_cond_wait(&n->cond, &n->mutex);
+    }
+    pthread_mutex_unlock(&n->mutex);
+    __atomic_fetch_sub(&n->waiters, 1, __ATOMIC_RELAXED);
+}
+
+void cancelNotifierWait(BufferNotifier* n) {
+    __atomic_fetch_sub(&n->waiters, 1, __ATOMIC_RELAXED);
+}
+
+void signalNotifier(BufferNotifier* n) {
+    notifyWaiters(n);
+}
+
+int enableBufferStats(BoundedBuffer* bb) {
+    if (bb->stats) {
+        return 0;
+    }
+    BufferStats* stats = NULL;
+    if (posix_memalign((void**)&stats, CACHE_LINE_SIZE, sizeof(BufferStats)) != 0) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(BufferStats));
+    bb->stats = stats;
+    return 0;
+}
+
+void getBufferStats(BoundedBuffer* bb, BufferStats* out) {
+    memset(out, 0, sizeof(BufferStats));
+    BufferStats* stats = bb->stats;
+    if (!stats) {
+        return;
+    }
+    out->enqueued = __atomic_load_n(&stats->enqueued, __ATOMIC_RELAXED);
+    out->fullWaits = __atomic_load_n(&stats->fullWaits, __ATOMIC_RELAXED);
+    out->fullWaitNs = __atomic_load_n(&stats->fullWaitNs, __ATOMIC_RELAXED);
+    out->highWater = __atomic_load_n(&stats->highWater, __ATOMIC_RELAXED);
+    out->dequeued = __atomic_load_n(&stats->dequeued, __ATOMIC_RELAXED);
+    out->emptyWaits = __atomic_load_n(&stats->emptyWaits, __ATOMIC_RELAXED);
+    out->emptyWaitNs = __atomic_load_n(&stats->emptyWaitNs, __ATOMIC_RELAXED);
+    out->lockContended = __atomic_load_n(&stats->lockContended, __ATOMIC_RELAXED);
+}
+
+void printBufferStats(FILE* out, const char* name, BoundedBuffer* bb) {
+    BufferStats s;
+    getBufferStats(bb, &s);
+    fprintf(out, "{\"name\":\"%s\",\"size\":%d,\"mode\":\"%s\",\"wait\":\"%s\",\"enqueued\":%llu,\"dequeued\":%llu,\"high_water\":%d,"
+            "\"full_waits\":%llu,\"full_wait_ms\":%.3f,\"empty_waits\":%llu,\"empty_wait_ms\":%.3f,"
+            "\"lock_contended\":%llu}",
+            name, bb->size, bufferModeNames[bb->mode], waitPolicyNames[bb->waitPolicy], s.enqueued, s.dequeued, s.highWater, s.fullWaits, s.fullWaitNs / 1e6,
+            s.emptyWaits, s.emptyWaitNs / 1e6, s.lockContended);
+}
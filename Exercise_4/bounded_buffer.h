@@ -3,22 +3,134 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdio.h>
 
+#define CACHE_LINE_SIZE 64
+
+// Synchronization strategy of a buffer, chosen when it is created
+typedef enum {
+    BB_LOCKED = 0,  // two counting semaphores + mutex, any number of threads
+    BB_SPSC = 1,    // lock-free ring, exactly one producer thread and one consumer thread
+    BB_MPMC = 2     // lock-free ring of sequence-numbered cells, any number of threads
+} BufferMode;
+
+extern const char* bufferModeNames[];  // "locked", "spsc", "mpmc"
+
+// How a thread waits for a free slot or an item once the buffer is full or empty
+typedef enum {
+    BB_WAIT_BLOCK = 0,            // sleep right away (default for BB_LOCKED and BB_MPMC)
+    BB_WAIT_SPIN_THEN_BLOCK = 1,  // retry with a pause for a bounded spin count, then sleep
+    BB_WAIT_SPIN = 2              // never sleep: pause, then yield the CPU (default for BB_SPSC)
+} WaitPolicy;
+
+extern const char* waitPolicyNames[];  // "block", "spin-then-block", "spin"
+
+#define DEFAULT_SPIN_LIMIT 1000  // retries before BB_WAIT_SPIN_THEN_BLOCK sleeps
+
+// Lets one thread sleep until any buffer in a group receives data. A waiter registers with
+// prepareNotifierWait(), re-checks its buffers, then either cancels or commits the wait, so
+// inserts only pay a fence and a load unless somebody is actually asleep.
+typedef struct {
+    unsigned int sequence;  // bumped whenever sleeping waiters must re-check
+    int waiters;            // threads between prepare and commit/cancel
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} BufferNotifier;
+
+// Optional per-buffer counters (see enableBufferStats). Fields written by the producer side,
+// the consumer side and both sides sit on separate cache lines; all updates are relaxed atomics.
 typedef struct {
-    char **buffer;
+    unsigned long long enqueued __attribute__((aligned(CACHE_LINE_SIZE)));
+    unsigned long long fullWaits;      // inserts that had to wait for a free slot
+    unsigned long long fullWaitNs;     // total time spent waiting for a free slot
+    int highWater;                     // most items ever queued at once
+    unsigned long long dequeued __attribute__((aligned(CACHE_LINE_SIZE)));
+    unsigned long long emptyWaits;     // removals that had to wait for an item
+    unsigned long long emptyWaitNs;    // total time spent waiting for an item
+    unsigned long long lockContended __attribute__((aligned(CACHE_LINE_SIZE)));  // mutex found held, or
+                                                                                 // ring slot lost to another thread
+} BufferStats;
+
+// BB_MPMC slot: the sequence number tells whose turn the cell is. It is 2 * position while a
+// writer may fill the cell and 2 * position + 1 once the item is there for a reader; doubling
+// keeps a full cell apart from the next lap's free one even in a one-cell ring.
+typedef struct {
+    unsigned long sequence;
+    void* data;
+} BufferCell;
+
+typedef struct {
+    void **buffer;
     int size;
+    BufferMode mode;
+    BufferNotifier* notifier;       // signalled after every insert, may be NULL
+    BufferNotifier* spaceNotifier;  // signalled after every removal, may be NULL
+    BufferStats* stats;        // NULL unless enableBufferStats() was called
+    WaitPolicy waitPolicy;
+    int spinLimit;             // retries before sleeping under BB_WAIT_SPIN_THEN_BLOCK
+    BufferNotifier* peerNotifier;  // rings only: lets writers and readers sleep unless the policy is BB_WAIT_SPIN
+    int openWriters;           // writers that have not called closeBoundedBuffer() yet
+    int closed;                // set by the last writer's close, read atomically
+
+    // BB_LOCKED state
     int in;
     int out;
     int count;
     sem_t empty;  // counting semaphore for empty slots
     sem_t full;   // counting semaphore for full slots
     pthread_mutex_t mutex;  // binary semaphore (mutex) for critical section
+
+    // BB_SPSC state. The ring holds a power-of-two number of slots so indexing is a mask,
+    // while at most 'size' items are stored. Consumer-owned and producer-owned fields live
+    // on separate cache lines so the two threads never false-share.
+    unsigned long mask;
+    unsigned long head __attribute__((aligned(CACHE_LINE_SIZE)));  // next slot to read (consumer)
+    unsigned long cachedTail;                                      // consumer's last view of tail
+    unsigned long tail __attribute__((aligned(CACHE_LINE_SIZE)));  // next slot to write (producer)
+    unsigned long cachedHead;                                      // producer's last view of head
+
+    // BB_MPMC state: 'size' cells indexed by position modulo size. Writers claim positions
+    // from tail and readers from head with a compare-and-swap, so both fields are shared.
+    BufferCell* cells;
 } BoundedBuffer;
 
 // Function declarations
-BoundedBuffer* createBoundedBuffer(int size);
-void insert(BoundedBuffer* bb, char* item);
-char* removeItem(BoundedBuffer* bb);
-void destroyBoundedBuffer(BoundedBuffer* bb);
+BoundedBuffer* createBoundedBuffer(int size, BufferMode mode);  // storage is first touched by the caller
+BufferMode chooseBufferMode(int writers, int readers);  // cheapest mode safe for that many threads
+// Inserts into a closed buffer are rejected and leave the item with the caller. Once the
+// buffer is closed and empty, removals return end of stream: NULL or 0 items.
+int insert(BoundedBuffer* bb, char* item);       // stores a private copy of item; 0 when closed
+int insertOwned(BoundedBuffer* bb, void* item);  // stores item itself; the consumer takes ownership
+void* removeItem(BoundedBuffer* bb);     // NULL at end of stream
+void* tryRemoveItem(BoundedBuffer* bb);  // returns NULL instead of blocking when empty
+// Batch variants move many items per critical section. Items are passed by ownership as in
+// insertOwned(); insertBatch blocks until all n are queued, removeBatch until at least one
+// item is available. Both return the number of items moved, fewer only once the buffer closed.
+int insertBatch(BoundedBuffer* bb, void** items, int n);
+int removeBatch(BoundedBuffer* bb, void** out, int max);
+int tryRemoveBatch(BoundedBuffer* bb, void** out, int max);  // returns 0 instead of blocking
+int tryInsertOwned(BoundedBuffer* bb, void* item);  // returns 0 instead of blocking when full
+int tryInsertBatch(BoundedBuffer* bb, void** items, int n);  // queues as many as fit, may be 0
+void setBufferWriters(BoundedBuffer* bb, int writers);  // before the buffer is shared, default 1
+void closeBoundedBuffer(BoundedBuffer* bb);  // one writer is done; the last one closes the buffer
+int isBufferClosed(BoundedBuffer* bb);
+int isBufferDrained(BoundedBuffer* bb);  // closed and empty: end of stream for a polling reader
+int bufferCount(BoundedBuffer* bb);  // items queued right now, a snapshot for statistics
+void destroyBoundedBuffer(BoundedBuffer* bb);  // free()s items still queued: drain owned items first
+
+void initBufferNotifier(BufferNotifier* n);
+void destroyBufferNotifier(BufferNotifier* n);
+void setBufferNotifier(BoundedBuffer* bb, BufferNotifier* n);
+void setBufferSpaceNotifier(BoundedBuffer* bb, BufferNotifier* n);  // for producers waiting on full buffers
+int setBufferWaitPolicy(BoundedBuffer* bb, WaitPolicy policy, int spinLimit);  // before the buffer is shared
+int parseWaitPolicy(const char* name, WaitPolicy* policy);  // 0 on success, -1 for an unknown name
+unsigned int prepareNotifierWait(BufferNotifier* n);        // returns the key for commit
+void commitNotifierWait(BufferNotifier* n, unsigned int key);  // sleeps unless notified since prepare
+void cancelNotifierWait(BufferNotifier* n);                  // found work after prepare
+void signalNotifier(BufferNotifier* n);  // wakes its waiters after publishing something they poll
+
+int enableBufferStats(BoundedBuffer* bb);  // call before the buffer is shared between threads
+void getBufferStats(BoundedBuffer* bb, BufferStats* out);  // snapshot, all zero when disabled
+void printBufferStats(FILE* out, const char* name, BoundedBuffer* bb);  // one JSON object
 
-#endif
\ No newline at end of file
+#endif
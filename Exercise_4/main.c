@@ -5,36 +5,122 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <signal.h>
 #include "bounded_buffer.h"
+#include "message_pool.h"
+#include "reorder_buffer.h"
+#include "message.h"
+#include "pipeline_stats.h"
+#include "output_writer.h"
+#include "placement.h"
 
-#define MAX_PRODUCERS 10
 #define MAX_STRING_SIZE 100
-
-// Message types
-typedef enum {
-    SPORTS = 0,
-    NEWS = 1,
-    WEATHER = 2
-} MessageType;
-
-const char* typeNames[] = {"SPORTS", "NEWS", "WEATHER"};
+#define DISPATCH_BATCH 16   // messages taken from one producer queue per round-robin turn
+#define DISPATCH_STAGE 64   // messages buffered per category before a batch insert, or held back per producer
+#define SCREEN_BATCH 32     // messages the screen manager takes per removal
 
 // Global variables
 int numProducers;
-int producerCounts[MAX_PRODUCERS];
-BoundedBuffer* producerQueues[MAX_PRODUCERS];
-BoundedBuffer* dispatcherQueues[3]; // S, N, W queues
+int producerCapacity;           // allocated length of producerCounts and producerQueues
+int* producerCounts;            // indexed by producer id - 1, grown while parsing
+int* producerQueueSizes;        // 0 until the producer's block was read
+BoundedBuffer** producerQueues;
+int producerThreadCount = 0;    // OS threads running the producers; 0 means one per producer
+BufferNotifier producerNotifier;  // shared by all dispatcher shards under skip/spill backpressure
+BoundedBuffer* dispatcherQueues[NUM_TYPES]; // S, N, W queues
+int dispatcherQueueSizes[NUM_TYPES] = {100, 100, 100};
+
+// What the dispatcher does with a story whose category queue is full
+typedef enum {
+    BACKPRESSURE_BLOCK = 0,  // wait for room, stalling every category
+    BACKPRESSURE_SKIP = 1,   // hold the story back per producer and category, keep routing the others
+    BACKPRESSURE_SPILL = 2   // keep routing into an unbounded per-category overflow list
+} Backpressure;
+
+const char* backpressureNames[] = {"block", "skip", "spill"};
+Backpressure dispatcherBackpressure = BACKPRESSURE_BLOCK;
 BoundedBuffer* coEditorQueue;
-int doneCount = 0;
-pthread_mutex_t doneCountMutex = PTHREAD_MUTEX_INITIALIZER;
+int coEditorQueueSize = 0;
+int coEditorsPerType = 1;  // size of each category's co-editor pool
+int reorderWindow = 0;     // early messages held per (producer, type); 0 disables reordering
+ReorderBuffer* reorderBuffer = NULL;
+MessagePool* messagePool;  // every message in flight is allocated here once, by its producer
+int editMicros[NUM_TYPES] = {100000, 100000, 100000};  // simulated editing time per message
+WaitPolicy dispatcherQueueWait = BB_WAIT_BLOCK;  // how co-editors wait on an empty dispatcher queue
+WaitPolicy coEditorQueueWait = BB_WAIT_BLOCK;    // how the co-editors and screen manager wait on theirs
+int waitSpinLimit = DEFAULT_SPIN_LIMIT;
+OutputWriter* output;       // the screen manager's buffered stdout or mapped output file
+char outputPath[256] = "";  // write to this file through mmap instead of stdout
+int outputBufferBytes = 65536;   // pending output that forces a flush
+int outputFlushMicros = 10000;   // oldest pending output is flushed after this long; 0 disables
+int statsEnabled = 0;      // --stats: measure latency and queue occupancy, report on stderr
+PipelineStats pipelineStats;
+int numDispatchers = 1;    // dispatcher threads, each owning a shard of the producer queues
+int cancelSignal = 0;      // SIGINT or SIGTERM received: producers stop early, the rest drains
+int allocationFailed = 0;  // the message pool could not grow: stops the producers like a cancel
+CoreSet producerCores;     // CPUs each stage's threads are pinned to; a queue's storage is
+CoreSet dispatcherCores;   // allocated on the cores of the stage consuming it
+CoreSet coEditorCores;
+CoreSet screenCores;
 
-// Producer data structure
+// Logical producer: many of them may share one OS thread
 typedef struct {
     int id;
     int numProducts;
+    int produced;
+    int typeCounts[NUM_TYPES];  // SPORTS, NEWS, WEATHER counters
+    unsigned int seed;          // rand_r() state, private to the producer
+    Message* pending;           // built but not yet accepted by a full queue
+    int finished;               // its queue has been closed
     BoundedBuffer* queue;
 } ProducerData;
 
+// Producer thread: runs a contiguous slice of the logical producers
+typedef struct {
+    ProducerData* producers;
+    int count;
+    BufferNotifier spaceNotifier;  // signalled when the dispatcher frees a slot in any of their queues
+} ProducerThreadData;
+
+ProducerThreadData* producerThreadData;
+
+// Messages routed to one category but not yet in its dispatcher queue, oldest first
+typedef struct {
+    Message** items;  // ring of 'capacity' entries
+    int head;
+    int count;
+    int capacity;     // DISPATCH_STAGE; grows only under BACKPRESSURE_SPILL
+} CategoryBacklog;
+
+// Stories taken from a producer queue whose category backlog was full, one ring per category,
+// so a slow category only holds up its own stories. Used by BACKPRESSURE_SKIP, and by
+// BACKPRESSURE_SPILL when a backlog cannot grow.
+typedef struct {
+    CategoryBacklog held[NUM_TYPES];  // rings of DISPATCH_STAGE; unused under BACKPRESSURE_BLOCK
+    int ended;  // the producer closed its queue and everything in it was taken
+} ProducerInbox;
+
+// One dispatcher thread's share of the producers and its routing state
+typedef struct {
+    int first;                 // owns producers [first, first + count)
+    int count;
+    BufferNotifier* notifier;  // signalled by its producer queues
+    BufferNotifier ownNotifier;
+    int endedCount;            // producers whose queue reached end of stream
+    int backlogHighWater;      // most stories ever waiting in one of its category backlogs
+    CategoryBacklog backlogs[NUM_TYPES];  // routed messages not yet handed to a dispatcher queue
+    ProducerInbox* inboxes;    // indexed by producer - first
+} DispatcherShard;
+
+DispatcherShard* dispatcherShards;
+
+// A thread polling several buffers that share a notifier
+typedef struct {
+    BufferNotifier* notifier;
+    int registered;  // between prepare and commit/cancel, doing the last scan before sleeping
+    unsigned int key;
+} PollWait;
+
 // Co-Editor data structure
 typedef struct {
     MessageType type;
@@ -42,100 +128,293 @@ typedef struct {
     BoundedBuffer* outputQueue;
 } CoEditorData;
 
-// Producer thread function
-void* producer(void* arg) {
-    ProducerData* data = (ProducerData*)arg;
-    int typeCounts[3] = {0, 0, 0}; // SPORTS, NEWS, WEATHER counters
+// Call after every scan pass. Instead of polling, an idle pass registers as a waiter and
+// scans once more, so work published meanwhile is never missed; a second idle pass sleeps.
+static void pollWaitPass(PollWait* wait, int foundWork) {
+    if (foundWork) {
+        if (wait->registered) {
+            cancelNotifierWait(wait->notifier);
+            wait->registered = 0;
+        }
+    } else if (!wait->registered) {
+        wait->key = prepareNotifierWait(wait->notifier);
+        wait->registered = 1;
+    } else {
+        commitNotifierWait(wait->notifier, wait->key);
+        wait->registered = 0;
+    }
+}
+
+// Call when leaving the polling loop
+static void pollWaitFinish(PollWait* wait) {
+    if (wait->registered) {
+        cancelNotifierWait(wait->notifier);
+        wait->registered = 0;
+    }
+}
+
+// Occupancy a consumer saw when it removed 'taken' items, for --stats. Writers may refill the
+// queue between the removal and the count, so the sum is capped at the queue's capacity.
+static int removalOccupancy(BoundedBuffer* queue, int taken) {
+    int occupancy = taken + bufferCount(queue);
+    return occupancy < queue->size ? occupancy : queue->size;
+}
+
+// Move a category's backlog into its dispatcher queue, oldest first. Waits for room under
+// BACKPRESSURE_BLOCK, otherwise moves only what fits. Returns the number of messages moved.
+static int flushBacklog(int type, CategoryBacklog* backlog) {
+    int moved = 0;
     
-    srand(time(NULL) + data->id); // Seed random number generator
+    while (backlog->count > 0) {
+        // The backlog is a ring: queue the part up to its end, then the wrapped part
+        int chunk = backlog->capacity - backlog->head;
+        if (chunk > backlog->count) {
+            chunk = backlog->count;
+        }
+        void** first = (void**)&backlog->items[backlog->head];
+        int n = dispatcherBackpressure == BACKPRESSURE_BLOCK
+                    ? insertBatch(dispatcherQueues[type], first, chunk)
+                    : tryInsertBatch(dispatcherQueues[type], first, chunk);
+        backlog->head = (backlog->head + n) % backlog->capacity;
+        backlog->count -= n;
+        moved += n;
+        if (n < chunk) {
+            break;
+        }
+    }
+    return moved;
+}
+
+// Double a backlog's ring, unwrapping it (BACKPRESSURE_SPILL)
+static int growBacklog(CategoryBacklog* backlog) {
+    int capacity = backlog->capacity * 2;
+    Message** items = (Message**)malloc(capacity * sizeof(Message*));
+    if (!items) {
+        return -1;
+    }
+    for (int i = 0; i < backlog->count; i++) {
+        items[i] = backlog->items[(backlog->head + i) % backlog->capacity];
+    }
+    free(backlog->items);
+    backlog->items = items;
+    backlog->head = 0;
+    backlog->capacity = capacity;
+    return 0;
+}
+
+// Build a producer's next story; NULL when the message pool cannot grow
+static Message* nextProducerMessage(ProducerData* data) {
+    MessageType type = rand_r(&data->seed) % NUM_TYPES;
+    Message* message = allocMessage(messagePool);
+    if (!message) {
+        return NULL;
+    }
+    message->producerId = data->id;
+    message->sequence = data->typeCounts[type];
+    message->type = type;
+    message->payloadLength = 0;
+    message->createdNs = statsEnabled ? nowNs() : 0;
+    data->typeCounts[type]++;
+    data->produced++;
+    return message;
+}
+
+// Producer thread function: offers one message per logical producer per pass, so a full
+// queue only parks its own producer while the others keep going. A producer closes its
+// queue after its last story, or as soon as the run is cancelled.
+void* producer(void* arg) {
+    ProducerThreadData* data = (ProducerThreadData*)arg;
+    PollWait wait = {&data->spaceNotifier, 0, 0};
+    int active = data->count;
     
-    for (int i = 0; i < data->numProducts; i++) {
-        MessageType type = rand() % 3;
-        char message[MAX_STRING_SIZE];
-        snprintf(message, MAX_STRING_SIZE, "Producer %d %s %d", 
-                data->id, typeNames[type], typeCounts[type]);
-        typeCounts[type]++;
+    while (active > 0) {
+        int progress = 0;
+        int cancelled = __atomic_load_n(&cancelSignal, __ATOMIC_ACQUIRE) ||
+                        __atomic_load_n(&allocationFailed, __ATOMIC_ACQUIRE);
+        
+        for (int i = 0; i < data->count; i++) {
+            ProducerData* current = &data->producers[i];
+            if (current->finished) {
+                continue;
+            }
+            if (cancelled || (!current->pending && current->produced == current->numProducts)) {
+                if (current->pending) {
+                    freeMessage(messagePool, current->pending);
+                    current->pending = NULL;
+                }
+                closeBoundedBuffer(current->queue);
+                current->finished = 1;
+                active--;
+                progress = 1;
+                continue;
+            }
+            if (!current->pending && !(current->pending = nextProducerMessage(current))) {
+                // Out of memory: every producer stops as on a cancel and the rest drains
+                if (!__atomic_exchange_n(&allocationFailed, 1, __ATOMIC_ACQ_REL)) {
+                    fprintf(stderr, "Error: Cannot allocate a message, stopping the producers\n");
+                    for (int t = 0; t < producerThreadCount; t++) {
+                        signalNotifier(&producerThreadData[t].spaceNotifier);
+                    }
+                }
+                progress = 1;
+                continue;
+            }
+            
+            // The same pointer travels through every queue up to the screen manager
+            if (tryInsertOwned(current->queue, current->pending)) {
+                current->pending = NULL;
+                progress = 1;
+            }
+        }
         
-        insert(data->queue, message);
+        if (active > 0) {
+            pollWaitPass(&wait, progress);
+        }
     }
     
-    // Send DONE message
-    insert(data->queue, "DONE");
-    
+    pollWaitFinish(&wait);
     return NULL;
 }
 
-// Dispatcher thread function
+// Append a story to its category's backlog. Returns 0 when the backlog is full and the
+// policy forbids blocking or growing it.
+static int dispatchMessage(DispatcherShard* shard, Message* message) {
+    int type = message->type;
+    CategoryBacklog* backlog = &shard->backlogs[type];
+    if (backlog->count == backlog->capacity) {
+        if (dispatcherBackpressure == BACKPRESSURE_BLOCK) {
+            flushBacklog(type, backlog);
+        } else if (dispatcherBackpressure == BACKPRESSURE_SKIP || growBacklog(backlog) != 0) {
+            return 0;
+        }
+    }
+    
+    backlog->items[(backlog->head + backlog->count) % backlog->capacity] = message;
+    backlog->count++;
+    if (backlog->count > shard->backlogHighWater) {
+        shard->backlogHighWater = backlog->count;
+    }
+    return 1;
+}
+
+// Route a producer's held-back stories, oldest first, each category until its backlog is full.
+// Returns 1 if anything was routed.
+static int releaseHeld(DispatcherShard* shard, ProducerInbox* inbox) {
+    int routed = 0;
+    
+    for (int type = 0; type < NUM_TYPES; type++) {
+        CategoryBacklog* held = &inbox->held[type];
+        while (held->count > 0 && dispatchMessage(shard, held->items[held->head])) {
+            held->head = (held->head + 1) % held->capacity;
+            held->count--;
+            routed = 1;
+        }
+    }
+    return routed;
+}
+
+// How many stories may be taken from a producer queue: under a policy that holds stories back,
+// no more than the fullest category's hold has room for, whatever their categories turn out to be
+static int holdRoom(const ProducerInbox* inbox) {
+    int room = DISPATCH_BATCH;
+    
+    if (dispatcherBackpressure != BACKPRESSURE_BLOCK) {
+        for (int type = 0; type < NUM_TYPES; type++) {
+            if (inbox->held[type].capacity - inbox->held[type].count < room) {
+                room = inbox->held[type].capacity - inbox->held[type].count;
+            }
+        }
+    }
+    return room;
+}
+
+// Route a batch taken from a producer queue, oldest first. A story is held back while its
+// category's backlog is full or older stories of that category are held, so every category
+// keeps the producer's order. Returns 1 if anything was routed.
+static int routeBatch(DispatcherShard* shard, ProducerInbox* inbox, Message** batch, int count) {
+    int routed = 0;
+    
+    for (int i = 0; i < count; i++) {
+        CategoryBacklog* held = &inbox->held[batch[i]->type];
+        if (held->count == 0 && dispatchMessage(shard, batch[i])) {
+            routed = 1;
+            continue;
+        }
+        held->items[(held->head + held->count) % held->capacity] = batch[i];
+        held->count++;
+    }
+    return routed;
+}
+
+// Dispatcher thread function: serves one shard of the producer queues
 void* dispatcher(void* arg) {
-    (void)arg; // Suppress unused parameter warning
+    DispatcherShard* shard = (DispatcherShard*)arg;
     int round = 0;
+    PollWait wait = {shard->notifier, 0, 0};
     
     while (1) {
-        int foundMessage = 0;
+        int progress = 0;
+        int held = 0;
         
-        // Round-robin through producer queues
-        for (int i = 0; i < numProducers; i++) {
-            int producerIndex = (round + i) % numProducers;
+        // Round-robin through the shard's producer queues, taking up to one batch from each
+        for (int i = 0; i < shard->count; i++) {
+            int slot = (round + i) % shard->count;
+            BoundedBuffer* queue = producerQueues[shard->first + slot];
+            ProducerInbox* inbox = &shard->inboxes[slot];
+            Message* batch[DISPATCH_BATCH];
             
-            // Try to get message without blocking
-            char* message = NULL;
+            // Stories held back earlier go first
+            if (releaseHeld(shard, inbox)) {
+                progress = 1;
+            }
             
-            // Check if queue has items (non-blocking check)
-            if (sem_trywait(&producerQueues[producerIndex]->full) == 0) {
-                pthread_mutex_lock(&producerQueues[producerIndex]->mutex);
-                
-                if (producerQueues[producerIndex]->count > 0) {
-                    message = producerQueues[producerIndex]->buffer[producerQueues[producerIndex]->out];
-                    producerQueues[producerIndex]->buffer[producerQueues[producerIndex]->out] = NULL;
-                    producerQueues[producerIndex]->out = (producerQueues[producerIndex]->out + 1) % producerQueues[producerIndex]->size;
-                    producerQueues[producerIndex]->count--;
-                }
-                
-                pthread_mutex_unlock(&producerQueues[producerIndex]->mutex);
-                sem_post(&producerQueues[producerIndex]->empty);
-                
-                if (message) {
-                    foundMessage = 1;
-                    
-                    if (strcmp(message, "DONE") == 0) {
-                        pthread_mutex_lock(&doneCountMutex);
-                        doneCount++;
-                        pthread_mutex_unlock(&doneCountMutex);
-                        free(message);
-                    } else {
-                        // Parse message and route to appropriate queue
-                        if (strstr(message, "SPORTS")) {
-                            insert(dispatcherQueues[SPORTS], message);
-                        } else if (strstr(message, "NEWS")) {
-                            insert(dispatcherQueues[NEWS], message);
-                        } else if (strstr(message, "WEATHER")) {
-                            insert(dispatcherQueues[WEATHER], message);
-                        }
-                        free(message);
-                    }
+            // Try to get messages without blocking, as many as can be held back if need be: a
+            // producer with a category's hold full is skipped
+            int room = holdRoom(inbox);
+            int taken = room > 0 ? tryRemoveBatch(queue, (void**)batch, room) : 0;
+            if (taken > 0) {
+                progress = 1;
+                if (statsEnabled) {
+                    sampleOccupancy(&pipelineStats, STAGE_PRODUCER, removalOccupancy(queue, taken));
                 }
+            } else if (!inbox->ended && isBufferDrained(queue)) {
+                inbox->ended = 1;
+                shard->endedCount++;
+            }
+            
+            if (taken > 0 && routeBatch(shard, inbox, batch, taken)) {
+                progress = 1;
             }
+            for (int type = 0; type < NUM_TYPES; type++) {
+                held += inbox->held[type].count;
+            }
+        }
+        
+        // Hand everything routed in this pass to the co-editors
+        int backlogged = 0;
+        for (int type = 0; type < NUM_TYPES; type++) {
+            if (flushBacklog(type, &shard->backlogs[type]) > 0) {
+                progress = 1;
+            }
+            backlogged += shard->backlogs[type].count;
         }
         
         round++;
         
-        // Check if all producers are done
-        pthread_mutex_lock(&doneCountMutex);
-        if (doneCount >= numProducers) {
-            pthread_mutex_unlock(&doneCountMutex);
+        // Check if the shard's producers are done and every story they sent has been handed on
+        if (shard->endedCount == shard->count && held == 0 && backlogged == 0) {
+            pollWaitFinish(&wait);
             break;
         }
-        pthread_mutex_unlock(&doneCountMutex);
         
-        // Small delay to prevent busy waiting
-        if (!foundMessage) {
-            usleep(1000); // 1ms
-        }
+        // Sleep until a producer inserts or, with a backlog, a co-editor frees a slot
+        pollWaitPass(&wait, progress);
     }
     
-    // Send DONE to all dispatcher queues
-    for (int i = 0; i < 3; i++) {
-        insert(dispatcherQueues[i], "DONE");
+    // Every shard writes to every category: the last one to close a queue ends its stream,
+    // behind every story of every shard
+    for (int type = 0; type < NUM_TYPES; type++) {
+        closeBoundedBuffer(dispatcherQueues[type]);
     }
     
     return NULL;
@@ -144,45 +423,309 @@ void* dispatcher(void* arg) {
 // Co-Editor thread function
 void* coEditor(void* arg) {
     CoEditorData* data = (CoEditorData*)arg;
+    Message* message;
     
-    while (1) {
-        char* message = removeItem(data->inputQueue);
-        
-        if (strcmp(message, "DONE") == 0) {
-            insert(data->outputQueue, message);
-            break;
+    // Edit until the category's queue is closed and drained
+    while ((message = removeItem(data->inputQueue)) != NULL) {
+        if (statsEnabled) {
+            sampleOccupancy(&pipelineStats, STAGE_DISPATCHER, removalOccupancy(data->inputQueue, 1));
         }
         
-        // Simulate editing process (0.1 second delay)
-        usleep(100000); // 100ms = 0.1 second
+        // Simulate editing process (0.1 second delay by default)
+        if (editMicros[data->type] > 0) {
+            usleep(editMicros[data->type]);
+        }
         
-        insert(data->outputQueue, message);
+        insertOwned(data->outputQueue, message);
     }
     
+    // The last co-editor to finish ends the screen manager's stream
+    closeBoundedBuffer(data->outputQueue);
     return NULL;
 }
 
+// The only place a message is turned into text
+static void displayMessage(const Message* message) {
+    char line[MAX_STRING_SIZE];
+    int length = formatMessage(message, line, sizeof(line) - 1);
+    if (length > (int)sizeof(line) - 2) {
+        length = sizeof(line) - 2;  // truncated like the formatted text
+    }
+    line[length++] = '\n';
+    writeOutput(output, line, length);
+    if (statsEnabled) {
+        recordLatency(&pipelineStats, message->createdNs);
+    }
+}
+
 // Screen Manager thread function
 void* screenManager(void* arg) {
     (void)arg; // Suppress unused parameter warning
-    int doneReceived = 0;
     
-    while (doneReceived < 3) {
-        char* message = removeItem(coEditorQueue);
+    Message* batch[SCREEN_BATCH];
+    // Messages become ready in batches of up to window + 1 once the reorder stage is on
+    int readyCapacity = reorderBuffer ? reorderBuffer->window + 1 : 1;
+    void** ready = (void**)malloc(readyCapacity * sizeof(void*));
+    
+    // Display until every co-editor has closed the queue and it is drained
+    while (1) {
+        // Everything displayed so far goes out before the screen manager blocks
+        int taken = tryRemoveBatch(coEditorQueue, (void**)batch, SCREEN_BATCH);
+        if (taken == 0) {
+            flushOutput(output);
+            taken = removeBatch(coEditorQueue, (void**)batch, SCREEN_BATCH);
+            if (taken == 0) {
+                break;
+            }
+        }
+        int finished = 0;  // batch[0..finished) may go back to the pool
+        if (statsEnabled) {
+            sampleOccupancy(&pipelineStats, STAGE_COEDITOR, removalOccupancy(coEditorQueue, taken));
+        }
         
-        if (strcmp(message, "DONE") == 0) {
-            doneReceived++;
-        } else {
-            printf("%s\n", message);
+        for (int i = 0; i < taken; i++) {
+            Message* message = batch[i];
+            
+            if (!reorderBuffer) {
+                displayMessage(message);
+                batch[finished++] = message;
+            } else {
+                // Held messages stay out of the pool until the reorder stage releases them
+                int count = reorderSubmit(reorderBuffer, message->producerId - 1, message->type,
+                                          message->sequence, message, ready);
+                for (int j = 0; j < count; j++) {
+                    displayMessage(ready[j]);
+                }
+                freeMessages(messagePool, ready, count);
+            }
         }
         
-        free(message);
+        freeMessages(messagePool, (void**)batch, finished);
+        flushOutputIfDue(output);
     }
     
-    printf("DONE\n");
+    // All producers are finished: print whatever still waits behind a skipped gap
+    if (reorderBuffer) {
+        int numKeys = reorderBuffer->numProducers * reorderBuffer->numTypes;
+        for (int key = 0; key < numKeys; key++) {
+            int count = reorderFlushKey(reorderBuffer, key, ready);
+            for (int j = 0; j < count; j++) {
+                displayMessage(ready[j]);
+            }
+            freeMessages(messagePool, ready, count);
+        }
+    }
+    
+    free(ready);
+    writeOutput(output, "DONE\n", 5);
+    flushOutput(output);
+    return NULL;
+}
+
+// Print every queue's counters as a JSON array
+static void printQueueStats(FILE* out) {
+    char name[32];
+    fprintf(out, "[");
+    for (int i = 0; i < numProducers; i++) {
+        snprintf(name, sizeof(name), "producer%d", i + 1);
+        fprintf(out, "%s", i > 0 ? "," : "");
+        printBufferStats(out, name, producerQueues[i]);
+    }
+    for (int i = 0; i < NUM_TYPES; i++) {
+        snprintf(name, sizeof(name), "dispatcher_%s", typeNames[i]);
+        fprintf(out, ",");
+        printBufferStats(out, name, dispatcherQueues[i]);
+    }
+    fprintf(out, ",");
+    printBufferStats(out, "coeditor", coEditorQueue);
+    fprintf(out, "]");
+}
+
+// Handles the signals blocked in every other thread, so they are only ever delivered here
+// through sigwait(). SIGUSR1 dumps live queue counters while the pipeline runs with --stats.
+// SIGINT and SIGTERM cancel the run: the producers close their queues, and everything
+// already produced drains through the pipeline before the screen manager prints DONE.
+void* signalHandler(void* arg) {
+    sigset_t* signals = (sigset_t*)arg;
+    int signal;
+    
+    while (sigwait(signals, &signal) == 0) {
+        if (signal == SIGUSR1) {
+            fprintf(stderr, "{\"queues\":");
+            printQueueStats(stderr);
+            fprintf(stderr, "}\n");
+            fflush(stderr);
+            continue;
+        }
+        __atomic_store_n(&cancelSignal, signal, __ATOMIC_SEQ_CST);
+        for (int t = 0; t < producerThreadCount; t++) {
+            signalNotifier(&producerThreadData[t].spaceNotifier);
+        }
+    }
     return NULL;
 }
 
+// Print the run's configuration and measurements as one JSON line
+static void reportStats(FILE* out) {
+    int backlogHighWater = 0;
+    for (int s = 0; s < numDispatchers; s++) {
+        if (dispatcherShards[s].backlogHighWater > backlogHighWater) {
+            backlogHighWater = dispatcherShards[s].backlogHighWater;
+        }
+    }
+    
+    fprintf(out, "{\"producers\":%d,\"producer_threads\":%d,\"dispatcher_threads\":%d,\"producer_queue_sizes\":[",
+            numProducers, producerThreadCount, numDispatchers);
+    for (int i = 0; i < numProducers; i++) {
+        fprintf(out, "%s%d", i > 0 ? "," : "", producerQueues[i]->size);
+    }
+    fprintf(out, "],\"dispatcher_queue_sizes\":[%d,%d,%d],\"dispatcher_backpressure\":\"%s\","
+            "\"dispatcher_backlog_high_water\":%d,\"coeditor_queue_size\":%d,\"coeditors_per_category\":%d,"
+            "\"edit_us\":[%d,%d,%d],\"reorder_window\":%d,",
+            dispatcherQueues[0]->size, dispatcherQueues[1]->size, dispatcherQueues[2]->size,
+            backpressureNames[dispatcherBackpressure], backlogHighWater, coEditorQueue->size,
+            coEditorsPerType, editMicros[0], editMicros[1], editMicros[2], reorderWindow);
+    fprintf(out, "\"placement\":{\"producer\":");
+    printCoreSet(out, &producerCores);
+    fprintf(out, ",\"dispatcher\":");
+    printCoreSet(out, &dispatcherCores);
+    fprintf(out, ",\"coeditor\":");
+    printCoreSet(out, &coEditorCores);
+    fprintf(out, ",\"screen\":");
+    printCoreSet(out, &screenCores);
+    fprintf(out, "},");
+    printPipelineStats(out, &pipelineStats);
+    fprintf(out, ",\"queues\":");
+    printQueueStats(out);
+    fprintf(out, "}\n");
+}
+
+// Split the producer queues into one contiguous shard per dispatcher thread
+static void createDispatcherShards(void) {
+    dispatcherShards = (DispatcherShard*)calloc(numDispatchers, sizeof(DispatcherShard));
+    for (int s = 0; s < numDispatchers; s++) {
+        DispatcherShard* shard = &dispatcherShards[s];
+        shard->first = (int)((long long)numProducers * s / numDispatchers);
+        shard->count = (int)((long long)numProducers * (s + 1) / numDispatchers) - shard->first;
+        shard->inboxes = (ProducerInbox*)calloc(shard->count, sizeof(ProducerInbox));
+        for (int i = 0; i < shard->count && dispatcherBackpressure != BACKPRESSURE_BLOCK; i++) {
+            for (int type = 0; type < NUM_TYPES; type++) {
+                shard->inboxes[i].held[type].items = (Message**)malloc(DISPATCH_STAGE * sizeof(Message*));
+                shard->inboxes[i].held[type].capacity = DISPATCH_STAGE;
+            }
+        }
+        for (int type = 0; type < NUM_TYPES; type++) {
+            shard->backlogs[type].items = (Message**)malloc(DISPATCH_STAGE * sizeof(Message*));
+            shard->backlogs[type].capacity = DISPATCH_STAGE;
+        }
+        
+        // A shard only wakes for its own producers, unless it may hold back stories: then it
+        // must also wake when any category frees a slot, so all shards share one notifier
+        if (dispatcherBackpressure == BACKPRESSURE_BLOCK) {
+            initBufferNotifier(&shard->ownNotifier);
+            shard->notifier = &shard->ownNotifier;
+        } else {
+            shard->notifier = &producerNotifier;
+        }
+        for (int i = shard->first; i < shard->first + shard->count; i++) {
+            setBufferNotifier(producerQueues[i], shard->notifier);
+        }
+    }
+}
+
+static void destroyDispatcherShards(void) {
+    for (int s = 0; s < numDispatchers; s++) {
+        DispatcherShard* shard = &dispatcherShards[s];
+        for (int type = 0; type < NUM_TYPES; type++) {
+            free(shard->backlogs[type].items);
+            for (int i = 0; i < shard->count; i++) {
+                free(shard->inboxes[i].held[type].items);
+            }
+        }
+        free(shard->inboxes);
+        if (shard->notifier == &shard->ownNotifier) {
+            destroyBufferNotifier(&shard->ownNotifier);
+        }
+    }
+    free(dispatcherShards);
+}
+
+// Make room for producer ids up to count, zero-filling the new entries
+static int reserveProducers(int count) {
+    if (count <= producerCapacity) {
+        return 0;
+    }
+    int capacity = producerCapacity > 0 ? producerCapacity : 16;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    int* counts = (int*)realloc(producerCounts, capacity * sizeof(int));
+    if (!counts) {
+        return -1;
+    }
+    producerCounts = counts;
+    BoundedBuffer** queues = (BoundedBuffer**)realloc(producerQueues, capacity * sizeof(BoundedBuffer*));
+    if (!queues) {
+        return -1;
+    }
+    producerQueues = queues;
+    int* sizes = (int*)realloc(producerQueueSizes, capacity * sizeof(int));
+    if (!sizes) {
+        return -1;
+    }
+    producerQueueSizes = sizes;
+    memset(producerCounts + producerCapacity, 0, (capacity - producerCapacity) * sizeof(int));
+    memset(producerQueueSizes + producerCapacity, 0, (capacity - producerCapacity) * sizeof(int));
+    memset(producerQueues + producerCapacity, 0, (capacity - producerCapacity) * sizeof(BoundedBuffer*));
+    producerCapacity = capacity;
+    return 0;
+}
+
+// Read "<setting> = <policy>" into policy
+static int parseWaitLine(const char* line, WaitPolicy* policy) {
+    char name[32] = "";
+    const char* value = strchr(line, '=');
+    if (!value || sscanf(value + 1, "%31s", name) != 1 || parseWaitPolicy(name, policy) != 0) {
+        printf("Error: Unknown wait policy in line: %s", line);
+        return -1;
+    }
+    return 0;
+}
+
+// Read "[CATEGORY] <setting> = <n>" into values[CATEGORY], or into every category's entry
+// when the line names none
+static int parseCategoryLine(const char* line, int* values, int minimum) {
+    int value;
+    const char* equals = strchr(line, '=');
+    if (!equals || sscanf(equals + 1, "%d", &value) != 1 || value < minimum) {
+        printf("Error: Invalid value in line: %s", line);
+        return -1;
+    }
+    
+    line += strspn(line, " \t");
+    for (int type = 0; type < NUM_TYPES; type++) {
+        if (strncmp(line, typeNames[type], strlen(typeNames[type])) == 0) {
+            values[type] = value;
+            return 0;
+        }
+    }
+    for (int type = 0; type < NUM_TYPES; type++) {
+        values[type] = value;
+    }
+    return 0;
+}
+
+// Read "<stage> cores = <list>" into set
+static int parseCoresLine(const char* line, CoreSet* set) {
+    char list[CORE_LIST_LENGTH] = "";
+    const char* value = strchr(line, '=');
+    if (!value || sscanf(value + 1, "%63s", list) != 1 || parseCoreSet(list, set) != 0) {
+        printf("Error: Invalid or unavailable cores in line: %s", line);
+        return -1;
+    }
+    return 0;
+}
+
 // Function to parse configuration file
 int parseConfig(const char* filename) {
     FILE* file = fopen(filename, "r");
@@ -193,11 +736,17 @@ int parseConfig(const char* filename) {
     
     char line[256];
     int producerIndex = 0;
-    int coEditorQueueSize = 0;
     
     while (fgets(line, sizeof(line), file)) {
         if (strstr(line, "PRODUCER")) {
+            producerIndex = 0;
             sscanf(line, "PRODUCER %d", &producerIndex);
+            if (producerIndex < 1 || reserveProducers(producerIndex) != 0 ||
+                producerQueueSizes[producerIndex - 1]) {
+                printf("Error: Invalid or repeated producer in line: %s", line);
+                fclose(file);
+                return -1;
+            }
             producerIndex--; // Convert to 0-based indexing
             
             // Read number of products
@@ -206,93 +755,366 @@ int parseConfig(const char* filename) {
             
             // Read queue size
             fgets(line, sizeof(line), file);
-            int queueSize;
+            int queueSize = 0;
             sscanf(line, "queue size = %d", &queueSize);
+            if (producerCounts[producerIndex] < 0 || queueSize < 1) {
+                printf("Error: Invalid settings for producer %d\n", producerIndex + 1);
+                fclose(file);
+                return -1;
+            }
+            producerQueueSizes[producerIndex] = queueSize;
             
-            // Create producer queue
-            producerQueues[producerIndex] = createBoundedBuffer(queueSize);
-            
-            numProducers = producerIndex + 1;
+            if (producerIndex + 1 > numProducers) {
+                numProducers = producerIndex + 1;
+            }
+        } else if (strstr(line, "Dispatcher threads")) {
+            sscanf(line, "Dispatcher threads = %d", &numDispatchers);
+            if (numDispatchers < 1) {
+                printf("Error: Dispatcher threads must be at least 1\n");
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Producer threads")) {
+            sscanf(line, "Producer threads = %d", &producerThreadCount);
+            if (producerThreadCount < 0) {
+                printf("Error: Producer threads must not be negative\n");
+                fclose(file);
+                return -1;
+            }
         } else if (strstr(line, "Co-Editor queue size")) {
             sscanf(line, "Co-Editor queue size = %d", &coEditorQueueSize);
-            coEditorQueue = createBoundedBuffer(coEditorQueueSize);
+        } else if (strstr(line, "Output file")) {
+            if (sscanf(line, "Output file = %255s", outputPath) != 1) {
+                printf("Error: Missing path in line: %s", line);
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Output buffer size")) {
+            sscanf(line, "Output buffer size = %d", &outputBufferBytes);
+        } else if (strstr(line, "Output flush interval")) {
+            sscanf(line, "Output flush interval = %d", &outputFlushMicros);
+        } else if (strstr(line, "Dispatcher queue wait")) {
+            if (parseWaitLine(line, &dispatcherQueueWait) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Co-Editor queue wait")) {
+            if (parseWaitLine(line, &coEditorQueueWait) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Wait spin limit")) {
+            sscanf(line, "Wait spin limit = %d", &waitSpinLimit);
+        } else if (strcasestr(line, "Edit time")) {
+            if (parseCategoryLine(line, editMicros, 0) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strcasestr(line, "Dispatcher queue size")) {
+            if (parseCategoryLine(line, dispatcherQueueSizes, 1) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Dispatcher backpressure")) {
+            char name[32] = "";
+            const char* equals = strchr(line, '=');
+            int found = 0;
+            if (equals && sscanf(equals + 1, "%31s", name) == 1) {
+                for (int i = BACKPRESSURE_BLOCK; i <= BACKPRESSURE_SPILL; i++) {
+                    if (strcmp(name, backpressureNames[i]) == 0) {
+                        dispatcherBackpressure = (Backpressure)i;
+                        found = 1;
+                    }
+                }
+            }
+            if (!found) {
+                printf("Error: Unknown backpressure policy in line: %s", line);
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Producer cores")) {
+            if (parseCoresLine(line, &producerCores) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Dispatcher cores")) {
+            if (parseCoresLine(line, &dispatcherCores) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Co-Editor cores")) {
+            if (parseCoresLine(line, &coEditorCores) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Screen Manager cores")) {
+            if (parseCoresLine(line, &screenCores) != 0) {
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Reorder window")) {
+            sscanf(line, "Reorder window = %d", &reorderWindow);
+            if (reorderWindow < 0) {
+                printf("Error: Reorder window must not be negative\n");
+                fclose(file);
+                return -1;
+            }
+        } else if (strstr(line, "Co-Editors per category")) {
+            sscanf(line, "Co-Editors per category = %d", &coEditorsPerType);
+            if (coEditorsPerType < 1) {
+                printf("Error: Co-Editors per category must be at least 1\n");
+                fclose(file);
+                return -1;
+            }
         }
     }
     
     fclose(file);
+    
+    // Producers may be listed in any order, but none may be missing
+    for (int i = 0; i < numProducers; i++) {
+        if (!producerQueueSizes[i]) {
+            printf("Error: PRODUCER %d is missing\n", i + 1);
+            return -1;
+        }
+    }
+    if (coEditorQueueSize < 1) {
+        printf("Error: Co-Editor queue size must be at least 1\n");
+        return -1;
+    }
+    if (numDispatchers > numProducers && numProducers > 0) {
+        numDispatchers = numProducers;
+    }
+    if (producerThreadCount == 0 || producerThreadCount > numProducers) {
+        producerThreadCount = numProducers;
+    }
     return 0;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <config_file>\n", argv[0]);
+    if (argc == 3 && strcmp(argv[2], "--stats") == 0) {
+        statsEnabled = 1;
+    } else if (argc != 2) {
+        printf("Usage: %s <config_file> [--stats]\n", argv[0]);
         return 1;
     }
     
+    initBufferNotifier(&producerNotifier);
+    
     // Parse configuration file
     if (parseConfig(argv[1]) != 0) {
         return 1;
     }
     
-    // Create dispatcher queues (fixed size for simplicity)
-    for (int i = 0; i < 3; i++) {
-        dispatcherQueues[i] = createBoundedBuffer(100);
+    // Create the queues. Each gets the cheapest mode that is safe for its writers and readers:
+    // a producer queue has one writer thread and is read by the dispatcher shard owning it, a
+    // category's queue is read by its whole co-editor pool and written by every dispatcher
+    // shard, and every co-editor writes to the shared queue. Each queue, and any state private
+    // to its consumer, is allocated while running on the consumer's cores so that it lands on
+    // their NUMA node.
+    cpu_set_t savedCpus;
+    enterCoreSet(&dispatcherCores, &savedCpus);
+    for (int i = 0; i < numProducers; i++) {
+        producerQueues[i] = createBoundedBuffer(producerQueueSizes[i], chooseBufferMode(1, 1));
+    }
+    createDispatcherShards();
+    leaveCoreSet(&dispatcherCores, &savedCpus);
+    
+    enterCoreSet(&coEditorCores, &savedCpus);
+    for (int i = 0; i < NUM_TYPES; i++) {
+        dispatcherQueues[i] = createBoundedBuffer(dispatcherQueueSizes[i],
+                                                  chooseBufferMode(numDispatchers, coEditorsPerType));
+        setBufferWaitPolicy(dispatcherQueues[i], dispatcherQueueWait, waitSpinLimit);
+        setBufferWriters(dispatcherQueues[i], numDispatchers);
+        if (dispatcherBackpressure != BACKPRESSURE_BLOCK) {
+            // A dispatcher holding back stories sleeps until a producer inserts or this frees up
+            setBufferSpaceNotifier(dispatcherQueues[i], &producerNotifier);
+        }
+    }
+    leaveCoreSet(&coEditorCores, &savedCpus);
+    
+    enterCoreSet(&screenCores, &savedCpus);
+    coEditorQueue = createBoundedBuffer(coEditorQueueSize, chooseBufferMode(NUM_TYPES * coEditorsPerType, 1));
+    setBufferWaitPolicy(coEditorQueue, coEditorQueueWait, waitSpinLimit);
+    setBufferWriters(coEditorQueue, NUM_TYPES * coEditorsPerType);
+    
+    // Screen output: buffered stdout, or a file written through a shared mapping
+    if (outputPath[0]) {
+        output = openMappedOutput(outputPath);
+    } else {
+        output = createOutputWriter(STDOUT_FILENO, outputBufferBytes, outputFlushMicros);
+    }
+    if (!output) {
+        printf("Error: Cannot open output %s\n", outputPath[0] ? outputPath : "stdout");
+        return 1;
+    }
+    
+    // Optional reorder stage in front of the screen manager
+    if (reorderWindow > 0) {
+        reorderBuffer = createReorderBuffer(numProducers, NUM_TYPES, reorderWindow);
+    }
+    leaveCoreSet(&screenCores, &savedCpus);
+    
+    // Size the message pool to everything the pipeline can hold at once: every queue and
+    // backlog full, the batches and messages in hand, and every reorder window full. Only
+    // BACKPRESSURE_SPILL backlogs are unbounded; the pool grows by a slab when they outgrow it.
+    int poolCapacity = coEditorQueue->size + 2 * numProducers + NUM_TYPES * coEditorsPerType + NUM_TYPES +
+                       SCREEN_BATCH + numDispatchers * NUM_TYPES * DISPATCH_STAGE +
+                       numProducers * NUM_TYPES * reorderWindow;
+    if (dispatcherBackpressure == BACKPRESSURE_SKIP) {
+        poolCapacity += numProducers * NUM_TYPES * DISPATCH_STAGE;  // every producer's holds full
+    } else {
+        poolCapacity += numDispatchers * DISPATCH_BATCH;  // the inbox being routed
+    }
+    for (int i = 0; i < numProducers; i++) {
+        poolCapacity += producerQueues[i]->size;
+    }
+    for (int i = 0; i < NUM_TYPES; i++) {
+        poolCapacity += dispatcherQueues[i]->size;
+    }
+    messagePool = createMessagePool(sizeof(Message), poolCapacity);
+    if (!messagePool) {
+        printf("Error: Cannot allocate the message pool\n");
+        return 1;
     }
     
     // Create threads
-    pthread_t producerThreads[MAX_PRODUCERS];
-    pthread_t dispatcherThread;
-    pthread_t coEditorThreads[3];
+    pthread_t* producerThreads = (pthread_t*)malloc(producerThreadCount * sizeof(pthread_t));
+    pthread_t* dispatcherThreads = (pthread_t*)malloc(numDispatchers * sizeof(pthread_t));
+    int numCoEditors = NUM_TYPES * coEditorsPerType;
+    pthread_t* coEditorThreads = (pthread_t*)malloc(numCoEditors * sizeof(pthread_t));
     pthread_t screenManagerThread;
     
-    // Create producer data and threads
-    ProducerData producerData[MAX_PRODUCERS];
+    pthread_t signalThread;
+    sigset_t signals;
+    if (statsEnabled) {
+        int totalMessages = 0;
+        for (int i = 0; i < numProducers; i++) {
+            totalMessages += producerCounts[i];
+            enableBufferStats(producerQueues[i]);
+        }
+        for (int i = 0; i < NUM_TYPES; i++) {
+            enableBufferStats(dispatcherQueues[i]);
+        }
+        enableBufferStats(coEditorQueue);
+        initPipelineStats(&pipelineStats, totalMessages);
+        pipelineStats.startNs = nowNs();
+    }
+    
+    // Create producer data and threads: each thread runs an equal slice of the producers
+    ProducerData* producerData = (ProducerData*)calloc(numProducers, sizeof(ProducerData));
     for (int i = 0; i < numProducers; i++) {
         producerData[i].id = i + 1;
         producerData[i].numProducts = producerCounts[i];
+        producerData[i].seed = time(NULL) + producerData[i].id;
         producerData[i].queue = producerQueues[i];
-        pthread_create(&producerThreads[i], NULL, producer, &producerData[i]);
     }
+    producerThreadData = (ProducerThreadData*)malloc(producerThreadCount * sizeof(ProducerThreadData));
+    for (int t = 0; t < producerThreadCount; t++) {
+        int first = (int)((long long)numProducers * t / producerThreadCount);
+        int last = (int)((long long)numProducers * (t + 1) / producerThreadCount);
+        producerThreadData[t].producers = &producerData[first];
+        producerThreadData[t].count = last - first;
+        initBufferNotifier(&producerThreadData[t].spaceNotifier);
+        for (int i = first; i < last; i++) {
+            setBufferSpaceNotifier(producerQueues[i], &producerThreadData[t].spaceNotifier);
+        }
+    }
+    
+    // Block the handled signals before any worker exists so all of them inherit the mask
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (statsEnabled) {
+        sigaddset(&signals, SIGUSR1);
+    }
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_create(&signalThread, NULL, signalHandler, &signals);
     
-    // Create dispatcher thread
-    pthread_create(&dispatcherThread, NULL, dispatcher, NULL);
+    pthread_attr_t attr;
+    initThreadAttr(&attr, &producerCores);
+    for (int t = 0; t < producerThreadCount; t++) {
+        pthread_create(&producerThreads[t], &attr, producer, &producerThreadData[t]);
+    }
+    pthread_attr_destroy(&attr);
+    
+    // Create dispatcher threads, one per shard
+    initThreadAttr(&attr, &dispatcherCores);
+    for (int s = 0; s < numDispatchers; s++) {
+        pthread_create(&dispatcherThreads[s], &attr, dispatcher, &dispatcherShards[s]);
+    }
+    pthread_attr_destroy(&attr);
     
-    // Create co-editor data and threads
-    CoEditorData coEditorData[3];
-    for (int i = 0; i < 3; i++) {
-        coEditorData[i].type = i;
-        coEditorData[i].inputQueue = dispatcherQueues[i];
+    // Create co-editor data and threads: each category's pool shares its dispatcher queue
+    CoEditorData* coEditorData = (CoEditorData*)malloc(numCoEditors * sizeof(CoEditorData));
+    initThreadAttr(&attr, &coEditorCores);
+    for (int i = 0; i < numCoEditors; i++) {
+        coEditorData[i].type = i % NUM_TYPES;
+        coEditorData[i].inputQueue = dispatcherQueues[i % NUM_TYPES];
         coEditorData[i].outputQueue = coEditorQueue;
-        pthread_create(&coEditorThreads[i], NULL, coEditor, &coEditorData[i]);
+        pthread_create(&coEditorThreads[i], &attr, coEditor, &coEditorData[i]);
     }
+    pthread_attr_destroy(&attr);
     
     // Create screen manager thread
-    pthread_create(&screenManagerThread, NULL, screenManager, NULL);
+    initThreadAttr(&attr, &screenCores);
+    pthread_create(&screenManagerThread, &attr, screenManager, NULL);
+    pthread_attr_destroy(&attr);
     
     // Wait for all threads to complete
-    for (int i = 0; i < numProducers; i++) {
-        pthread_join(producerThreads[i], NULL);
+    for (int t = 0; t < producerThreadCount; t++) {
+        pthread_join(producerThreads[t], NULL);
     }
     
-    pthread_join(dispatcherThread, NULL);
+    for (int s = 0; s < numDispatchers; s++) {
+        pthread_join(dispatcherThreads[s], NULL);
+    }
     
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < numCoEditors; i++) {
         pthread_join(coEditorThreads[i], NULL);
     }
     
     pthread_join(screenManagerThread, NULL);
+    pthread_cancel(signalThread);
+    pthread_join(signalThread, NULL);
+    
+    if (statsEnabled) {
+        pipelineStats.endNs = nowNs();
+        reportStats(stderr);
+        destroyPipelineStats(&pipelineStats);
+    }
     
     // Clean up
     for (int i = 0; i < numProducers; i++) {
         destroyBoundedBuffer(producerQueues[i]);
     }
     
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < NUM_TYPES; i++) {
         destroyBoundedBuffer(dispatcherQueues[i]);
     }
     
     destroyBoundedBuffer(coEditorQueue);
-    pthread_mutex_destroy(&doneCountMutex);
+    closeOutputWriter(output);
+    destroyReorderBuffer(reorderBuffer);
+    destroyMessagePool(messagePool);
+    for (int t = 0; t < producerThreadCount; t++) {
+        destroyBufferNotifier(&producerThreadData[t].spaceNotifier);
+    }
+    destroyDispatcherShards();
+    free(dispatcherThreads);
+    free(producerThreadData);
+    free(producerData);
+    free(producerThreads);
+    free(producerCounts);
+    free(producerQueueSizes);
+    free(producerQueues);
+    free(coEditorThreads);
+    free(coEditorData);
+    destroyBufferNotifier(&producerNotifier);
     
-    return 0;
+    // A cancelled run reports the signal that stopped it, like the shell would
+    if (allocationFailed) {
+        return 1;
+    }
+    return cancelSignal ? 128 + cancelSignal : 0;
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+#include "message.h"
+#include <stdio.h>
+
+const char* typeNames[] = {"SPORTS", "NEWS", "WEATHER"};
+
+int formatMessage(const Message* message, char* out, size_t size) {
+    if (message->payloadLength > 0) {
+        return snprintf(out, size, "Producer %d %s %d %.*s", message->producerId,
+                        typeNames[message->type], message->sequence,
+                        (int)message->payloadLength, message->payload);
+    }
+    return snprintf(out, size, "Producer %d %s %d", message->producerId,
+                    typeNames[message->type], message->sequence);
+}
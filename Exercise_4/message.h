@@ -0,0 +1,36 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <stddef.h>
+#include "bounded_buffer.h"
+
+#define NUM_TYPES 3
+#define MESSAGE_PAYLOAD_SIZE 40
+
+// Message types
+typedef enum {
+    SPORTS = 0,
+    NEWS = 1,
+    WEATHER = 2
+} MessageType;
+
+// A story as it travels through the pipeline. Routing reads 'type' directly and the text
+// form is only produced by formatMessage() at the screen manager. Fits one cache line.
+typedef struct {
+    int producerId;
+    int sequence;                        // stories of this type the producer sent before this one
+    unsigned char type;                  // MessageType
+    unsigned short payloadLength;        // bytes of payload in use, 0 for none
+    long long createdNs;                 // CLOCK_MONOTONIC time the producer made it, when measuring
+    char payload[MESSAGE_PAYLOAD_SIZE];  // optional free text, not NUL-terminated
+} Message;
+
+// Compile-time check that a message never straddles two cache lines
+typedef char MessageFitsCacheLine[sizeof(Message) <= CACHE_LINE_SIZE ? 1 : -1];
+
+extern const char* typeNames[];
+
+// Writes "Producer <id> <TYPE> <sequence>[ payload]" and returns its length like snprintf
+int formatMessage(const Message* message, char* out, size_t size);
+
+#endif
@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include "message_pool.h"
+#include <stdlib.h>
+
+#define POOL_ALIGNMENT 64  // keep messages on separate cache lines
+
+// Allocate one slab and thread its messages onto the free list; caller holds the mutex
+static int growPool(MessagePool* pool) {
+    size_t header = (sizeof(MessageSlab) + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+    MessageSlab* slab = NULL;
+    if (posix_memalign((void**)&slab, POOL_ALIGNMENT,
+                       header + pool->messageSize * pool->slabCapacity) != 0) {
+        return -1;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    char* first = (char*)slab + header;
+    for (int i = pool->slabCapacity - 1; i >= 0; i--) {
+        void* message = first + (size_t)i * pool->messageSize;
+        *(void**)message = pool->freeList;
+        pool->freeList = message;
+    }
+    return 0;
+}
+
+MessagePool* createMessagePool(size_t messageSize, int slabCapacity) {
+    MessagePool* pool = (MessagePool*)malloc(sizeof(MessagePool));
+    if (!pool) {
+        return NULL;
+    }
+    if (messageSize < sizeof(void*)) {
+        messageSize = sizeof(void*);
+    }
+    pool->messageSize = (messageSize + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+    pool->slabCapacity = slabCapacity > 0 ? slabCapacity : 1;
+    pool->freeList = NULL;
+    pool->slabs = NULL;
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    // Pre-allocate the first slab so a correctly sized pool never grows
+    if (growPool(pool) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void* allocMessage(MessagePool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+
+    if (!pool->freeList && growPool(pool) != 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        return NULL;
+    }
+    void* message = pool->freeList;
+    pool->freeList = *(void**)message;
+
+    pthread_mutex_unlock(&pool->mutex);
+    return message;
+}
+
+void freeMessage(MessagePool* pool, void* message) {
+    if (!message) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    *(void**)message = pool->freeList;
+    pool->freeList = message;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void freeMessages(MessagePool* pool, void** messages, int n) {
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < n; i++) {
+        if (messages[i]) {
+            *(void**)messages[i] = pool->freeList;
+            pool->freeList = messages[i];
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void destroyMessagePool(MessagePool* pool) {
+    if (pool) {
+        MessageSlab* slab = pool->slabs;
+        while (slab) {
+            MessageSlab* next = slab->next;
+            free(slab);
+            slab = next;
+        }
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Fixed-size message allocator. Memory is carved out of large slabs and recycled through
+// a free list, so once the pipeline reaches steady state no message touches malloc/free.
+typedef struct MessageSlab {
+    struct MessageSlab* next;
+} MessageSlab;
+
+typedef struct {
+    size_t messageSize;     // bytes per message, rounded up to a cache line
+    int slabCapacity;       // messages per slab when the pool has to grow
+    void* freeList;         // recycled messages, linked through their first word
+    MessageSlab* slabs;     // every slab ever allocated, released on destroy
+    pthread_mutex_t mutex;  // protects freeList and slabs
+} MessagePool;
+
+// Function declarations
+MessagePool* createMessagePool(size_t messageSize, int slabCapacity);
+void* allocMessage(MessagePool* pool);
+void freeMessage(MessagePool* pool, void* message);
+void freeMessages(MessagePool* pool, void** messages, int n);  // one lock for the whole batch
+void destroyMessagePool(MessagePool* pool);
+
+#endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "output_writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static long long monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Write every byte described by iov, resuming after short writes and signals
+static int writeAll(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // Skip the fully written entries, then trim the partly written one
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+OutputWriter* createOutputWriter(int fd, size_t flushBytes, int flushMicros) {
+    OutputWriter* w = (OutputWriter*)calloc(1, sizeof(OutputWriter));
+    if (!w) {
+        return NULL;
+    }
+    w->mode = OUTPUT_FD;
+    w->fd = fd;
+    w->flushNs = flushMicros > 0 ? flushMicros * 1000LL : 0;
+
+    // One writev() takes at most IOV_MAX chunks
+    int numChunks = (int)((flushBytes + OUTPUT_CHUNK_SIZE - 1) / OUTPUT_CHUNK_SIZE);
+    if (numChunks < 1) {
+        numChunks = 1;
+    } else if (numChunks > IOV_MAX) {
+        numChunks = IOV_MAX;
+    }
+
+    w->chunks = (struct iovec*)malloc(numChunks * sizeof(struct iovec));
+    char* storage = (char*)malloc((size_t)numChunks * OUTPUT_CHUNK_SIZE);
+    if (!w->chunks || !storage) {
+        free(w->chunks);
+        free(storage);
+        free(w);
+        return NULL;
+    }
+    for (int i = 0; i < numChunks; i++) {
+        w->chunks[i].iov_base = storage + (size_t)i * OUTPUT_CHUNK_SIZE;
+        w->chunks[i].iov_len = 0;
+    }
+    w->numChunks = numChunks;
+    return w;
+}
+
+OutputWriter* openMappedOutput(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    OutputWriter* w = (OutputWriter*)calloc(1, sizeof(OutputWriter));
+    if (!w) {
+        close(fd);
+        return NULL;
+    }
+    w->mode = OUTPUT_MMAP;
+    w->fd = fd;
+    return w;
+}
+
+// Extend the file by one extent and map it in place of the full one
+static int mapNextExtent(OutputWriter* w) {
+    if (w->map) {
+        munmap(w->map, OUTPUT_MAP_EXTENT);
+        w->map = NULL;
+        w->mapOffset += OUTPUT_MAP_EXTENT;
+    }
+    if (ftruncate(w->fd, w->mapOffset + OUTPUT_MAP_EXTENT) != 0) {
+        return -1;
+    }
+    void* map = mmap(NULL, OUTPUT_MAP_EXTENT, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, w->mapOffset);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    w->map = (char*)map;
+    w->mapUsed = 0;
+    return 0;
+}
+
+static int writeMapped(OutputWriter* w, const char* data, size_t length) {
+    while (length > 0) {
+        if (!w->map || w->mapUsed == OUTPUT_MAP_EXTENT) {
+            if (mapNextExtent(w) != 0) {
+                return -1;
+            }
+        }
+        size_t room = OUTPUT_MAP_EXTENT - w->mapUsed;
+        size_t copied = length < room ? length : room;
+        memcpy(w->map + w->mapUsed, data, copied);
+        w->mapUsed += copied;
+        data += copied;
+        length -= copied;
+    }
+    return 0;
+}
+
+int writeOutput(OutputWriter* w, const char* data, size_t length) {
+    if (w->failed) {
+        return -1;
+    }
+    if (w->mode == OUTPUT_MMAP) {
+        w->failed = writeMapped(w, data, length) != 0;
+        return w->failed ? -1 : 0;
+    }
+
+    // Text that could never fit a chunk goes out directly, behind what is pending
+    if (length > OUTPUT_CHUNK_SIZE) {
+        if (flushOutput(w) != 0) {
+            return -1;
+        }
+        struct iovec direct = {(void*)data, length};
+        w->failed = writeAll(w->fd, &direct, 1) != 0;
+        return w->failed ? -1 : 0;
+    }
+
+    struct iovec* chunk = &w->chunks[w->current];
+    if (chunk->iov_len + length > OUTPUT_CHUNK_SIZE) {
+        // Size threshold: every chunk is in use
+        if (w->current + 1 == w->numChunks) {
+            if (flushOutput(w) != 0) {
+                return -1;
+            }
+        } else {
+            w->current++;
+        }
+        chunk = &w->chunks[w->current];
+    }
+
+    if (w->pending == 0 && w->flushNs > 0) {
+        w->pendingSinceNs = monotonicNs();
+    }
+    memcpy((char*)chunk->iov_base + chunk->iov_len, data, length);
+    chunk->iov_len += length;
+    w->pending += length;
+    return 0;
+}
+
+int flushOutput(OutputWriter* w) {
+    if (w->failed) {
+        return -1;
+    }
+    if (w->mode == OUTPUT_MMAP || w->pending == 0) {
+        return 0;  // mapped output is already in the page cache
+    }
+
+    // writeAll() advances the iovecs, so hand it a copy and keep the chunk addresses
+    struct iovec gathered[IOV_MAX];
+    int count = w->current + 1;
+    memcpy(gathered, w->chunks, count * sizeof(struct iovec));
+    w->failed = writeAll(w->fd, gathered, count) != 0;
+
+    for (int i = 0; i < count; i++) {
+        w->chunks[i].iov_len = 0;
+    }
+    w->current = 0;
+    w->pending = 0;
+    return w->failed ? -1 : 0;
+}
+
+int flushOutputIfDue(OutputWriter* w) {
+    if (w->pending == 0 || w->flushNs == 0 || monotonicNs() - w->pendingSinceNs < w->flushNs) {
+        return 0;
+    }
+    return flushOutput(w);
+}
+
+int closeOutputWriter(OutputWriter* w) {
+    if (!w) {
+        return 0;
+    }
+    int result = flushOutput(w);
+
+    if (w->mode == OUTPUT_MMAP) {
+        // Drop the unused tail of the last extent
+        if (w->map) {
+            munmap(w->map, OUTPUT_MAP_EXTENT);
+        }
+        if (ftruncate(w->fd, w->mapOffset + w->mapUsed) != 0 || close(w->fd) != 0) {
+            result = -1;
+        }
+    } else {
+        free(w->chunks[0].iov_base);
+        free(w->chunks);
+    }
+    free(w);
+    return result;
+}
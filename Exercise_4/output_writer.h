@@ -0,0 +1,46 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define OUTPUT_CHUNK_SIZE 4096        // lines are packed into chunks of this size, never split
+#define OUTPUT_MAP_EXTENT (1 << 20)   // a mapped output file grows by this much at a time
+
+typedef enum {
+    OUTPUT_FD = 0,   // chunks gathered with one writev() per flush
+    OUTPUT_MMAP = 1  // lines copied straight into a shared mapping of the output file
+} OutputMode;
+
+// Single-threaded output stage. Text is accumulated instead of written per line and
+// reaches the file descriptor when flushBytes are pending, when the oldest pending byte
+// is older than the flush interval (see flushOutputIfDue), or on an explicit flush.
+typedef struct {
+    OutputMode mode;
+    int fd;
+    int failed;               // a write or mapping failed; later output is dropped
+
+    // OUTPUT_FD state
+    struct iovec* chunks;     // iov_len is the number of bytes used in each chunk
+    int numChunks;
+    int current;              // chunk being filled
+    size_t pending;           // bytes accumulated since the last flush
+    long long flushNs;        // 0 disables the time threshold
+    long long pendingSinceNs; // when the first pending byte arrived
+
+    // OUTPUT_MMAP state
+    char* map;                // current extent of the file, NULL before the first write
+    off_t mapOffset;          // file offset of the current extent
+    size_t mapUsed;           // bytes written into the current extent
+} OutputWriter;
+
+// Function declarations
+OutputWriter* createOutputWriter(int fd, size_t flushBytes, int flushMicros);
+OutputWriter* openMappedOutput(const char* path);  // creates or truncates the file
+int writeOutput(OutputWriter* w, const char* data, size_t length);
+int flushOutput(OutputWriter* w);        // call before the writer's thread blocks
+int flushOutputIfDue(OutputWriter* w);   // flushes only when the time threshold has passed
+int closeOutputWriter(OutputWriter* w);  // flushes and frees w; a mapped file is trimmed and closed
+
+#endif
@@ -0,0 +1,79 @@
+#define _GNU_SOURCE
+#include "pipeline_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const char* stageNames[] = {"producer", "dispatcher", "coeditor"};
+
+long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int initPipelineStats(PipelineStats* stats, int expectedMessages) {
+    memset(stats, 0, sizeof(PipelineStats));
+    stats->latencyCapacity = expectedMessages > 0 ? expectedMessages : 1;
+    stats->latencies = (long long*)malloc(stats->latencyCapacity * sizeof(long long));
+    return stats->latencies ? 0 : -1;
+}
+
+void sampleOccupancy(PipelineStats* stats, Stage stage, int occupancy) {
+    StageOccupancy* o = &stats->occupancy[stage];
+    __atomic_fetch_add(&o->samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&o->total, occupancy, __ATOMIC_RELAXED);
+
+    int max = __atomic_load_n(&o->max, __ATOMIC_RELAXED);
+    while (occupancy > max &&
+           !__atomic_compare_exchange_n(&o->max, &max, occupancy, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void recordLatency(PipelineStats* stats, long long createdNs) {
+    if (stats->latencyCount < stats->latencyCapacity) {
+        stats->latencies[stats->latencyCount++] = nowNs() - createdNs;
+    }
+}
+
+static int compareLongLong(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentileUs(long long* sorted, int count, double fraction) {
+    if (count == 0) {
+        return 0.0;
+    }
+    int index = (int)(fraction * count);
+    if (index >= count) {
+        index = count - 1;
+    }
+    return sorted[index] / 1e3;
+}
+
+void printPipelineStats(FILE* out, PipelineStats* stats) {
+    int count = stats->latencyCount;
+    double elapsed = (stats->endNs - stats->startNs) / 1e9;
+    qsort(stats->latencies, count, sizeof(long long), compareLongLong);
+
+    fprintf(out, "\"messages\":%d,\"elapsed_s\":%.6f,\"msgs_per_sec\":%.1f,", count, elapsed,
+            elapsed > 0 ? count / elapsed : 0.0);
+    fprintf(out, "\"latency_us\":{\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f},",
+            percentileUs(stats->latencies, count, 0.50), percentileUs(stats->latencies, count, 0.99),
+            percentileUs(stats->latencies, count, 0.999), percentileUs(stats->latencies, count, 1.0));
+
+    fprintf(out, "\"occupancy\":{");
+    for (int i = 0; i < NUM_STAGES; i++) {
+        StageOccupancy* o = &stats->occupancy[i];
+        fprintf(out, "%s\"%s\":{\"avg\":%.2f,\"max\":%d}", i > 0 ? "," : "", stageNames[i],
+                o->samples > 0 ? (double)o->total / o->samples : 0.0, o->max);
+    }
+    fprintf(out, "}");
+}
+
+void destroyPipelineStats(PipelineStats* stats) {
+    free(stats->latencies);
+    stats->latencies = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <stdio.h>
+
+// Queue stages whose occupancy is sampled, named by the buffers' consumers' view
+typedef enum {
+    STAGE_PRODUCER = 0,    // producer queues, sampled by the dispatcher
+    STAGE_DISPATCHER = 1,  // dispatcher queues, sampled by the co-editors
+    STAGE_COEDITOR = 2,    // co-editor queue, sampled by the screen manager
+    NUM_STAGES = 3
+} Stage;
+
+typedef struct {
+    long long samples;
+    long long total;  // sum of the sampled occupancies
+    int max;
+} StageOccupancy;
+
+// Measurements taken while the pipeline runs with --stats
+typedef struct {
+    StageOccupancy occupancy[NUM_STAGES];
+    long long* latencies;  // producer-to-screen delay in ns, written by the screen manager only
+    int latencyCount;
+    int latencyCapacity;
+    long long startNs;
+    long long endNs;
+} PipelineStats;
+
+extern const char* stageNames[];
+
+// Function declarations
+long long nowNs(void);
+int initPipelineStats(PipelineStats* stats, int expectedMessages);
+void sampleOccupancy(PipelineStats* stats, Stage stage, int occupancy);  // safe from any thread
+void recordLatency(PipelineStats* stats, long long createdNs);            // screen manager only
+// Prints the measured fields as the body of a JSON object (no surrounding braces)
+void printPipelineStats(FILE* out, PipelineStats* stats);
+void destroyPipelineStats(PipelineStats* stats);
+
+#endif
@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include "placement.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NUMA node of a CPU, from the nodeN link sysfs puts in its directory; -1 when unknown
+static int cpuNode(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+
+    int node = -1;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) {
+            break;
+        }
+        node = -1;
+    }
+    closedir(dir);
+    return node;
+}
+
+int parseCoreSet(const char* list, CoreSet* set) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+
+    memset(set, 0, sizeof(CoreSet));
+    CPU_ZERO(&set->cpus);
+    const char* p = list;
+    while (*p) {
+        // One "<cpu>" or "<first>-<last>" entry, then a comma or the end
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return -1;
+        }
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1) {
+                return -1;
+            }
+            p = end;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                return -1;
+            }
+            CPU_SET(cpu, &set->cpus);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    if (CPU_COUNT(&set->cpus) == 0) {
+        return -1;
+    }
+
+    set->pinned = 1;
+    set->node = -2;  // not seen yet
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set->cpus)) {
+            int node = cpuNode(cpu);
+            set->node = set->node == -2 || set->node == node ? node : -1;
+        }
+    }
+    snprintf(set->list, sizeof(set->list), "%s", list);
+    return 0;
+}
+
+int initThreadAttr(pthread_attr_t* attr, const CoreSet* set) {
+    if (pthread_attr_init(attr) != 0) {
+        return -1;
+    }
+    if (set->pinned) {
+        return pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &set->cpus) == 0 ? 0 : -1;
+    }
+    return 0;
+}
+
+void enterCoreSet(const CoreSet* set, cpu_set_t* saved) {
+    if (set->pinned && pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), saved) == 0) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set->cpus);
+    }
+}
+
+void leaveCoreSet(const CoreSet* set, const cpu_set_t* saved) {
+    if (set->pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), saved);
+    }
+}
+
+void printCoreSet(FILE* out, const CoreSet* set) {
+    if (set->pinned) {
+        fprintf(out, "{\"cores\":\"%s\",\"node\":%d}", set->list, set->node);
+    } else {
+        fprintf(out, "{\"cores\":\"any\",\"node\":-1}");
+    }
+}
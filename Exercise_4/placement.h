@@ -0,0 +1,28 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define CORE_LIST_LENGTH 64
+
+// The CPUs a pipeline stage's threads are pinned to. cpu_set_t needs _GNU_SOURCE defined
+// before the first system header.
+typedef struct {
+    int pinned;                   // 0: the threads may run anywhere
+    cpu_set_t cpus;
+    int node;                     // NUMA node of every CPU in the set, -1 if unknown or mixed
+    char list[CORE_LIST_LENGTH];  // the set as configured, e.g. "0-3,8"
+} CoreSet;
+
+// Function declarations
+int parseCoreSet(const char* list, CoreSet* set);  // fails on CPUs this process may not use
+int initThreadAttr(pthread_attr_t* attr, const CoreSet* set);  // pins threads created with attr
+// Moves the calling thread onto set, so memory it touches first is allocated on the set's
+// node; saved receives the old mask for leaveCoreSet()
+void enterCoreSet(const CoreSet* set, cpu_set_t* saved);
+void leaveCoreSet(const CoreSet* set, const cpu_set_t* saved);
+void printCoreSet(FILE* out, const CoreSet* set);  // as a JSON object
+
+#endif
@@ -0,0 +1,109 @@
+#include "reorder_buffer.h"
+#include <stdlib.h>
+
+ReorderBuffer* createReorderBuffer(int numProducers, int numTypes, int window) {
+    ReorderBuffer* rb = (ReorderBuffer*)malloc(sizeof(ReorderBuffer));
+    if (!rb) {
+        return NULL;
+    }
+    rb->numProducers = numProducers;
+    rb->numTypes = numTypes;
+    rb->window = window > 0 ? window : 1;
+    rb->keys = (ReorderKey*)calloc((size_t)numProducers * numTypes, sizeof(ReorderKey));
+    if (!rb->keys) {
+        free(rb);
+        return NULL;
+    }
+    return rb;
+}
+
+// Move the in-order run starting at key->next to 'ready'
+static int releaseInOrder(ReorderBuffer* rb, ReorderKey* key, void** ready) {
+    int count = 0;
+    while (key->pending > 0) {
+        void** slot = &key->slots[key->next % rb->window];
+        if (!*slot) {
+            break;
+        }
+        ready[count++] = *slot;
+        *slot = NULL;
+        key->pending--;
+        key->next++;
+    }
+    return count;
+}
+
+int reorderSubmit(ReorderBuffer* rb, int producer, int type, int sequence, void* message, void** ready) {
+    if (producer < 0 || producer >= rb->numProducers || type < 0 || type >= rb->numTypes) {
+        ready[0] = message;  // not ours to order
+        return 1;
+    }
+    ReorderKey* key = &rb->keys[producer * rb->numTypes + type];
+    int count = 0;
+
+    // Late message whose gap was already given up on, or simply the next one
+    if (sequence <= key->next) {
+        ready[count++] = message;
+        if (sequence == key->next) {
+            key->next++;
+            count += releaseInOrder(rb, key, ready + count);
+        }
+        return count;
+    }
+
+    if (!key->slots) {
+        key->slots = (void**)calloc(rb->window, sizeof(void*));
+        if (!key->slots) {
+            ready[0] = message;
+            return 1;
+        }
+    }
+
+    // Too far ahead: skip over the oldest missing sequence numbers until it fits
+    while (sequence - key->next >= rb->window) {
+        void** slot = &key->slots[key->next % rb->window];
+        if (*slot) {
+            ready[count++] = *slot;
+            *slot = NULL;
+            key->pending--;
+        }
+        key->next++;
+        count += releaseInOrder(rb, key, ready + count);
+    }
+
+    if (sequence == key->next) {
+        ready[count++] = message;
+        key->next++;
+        count += releaseInOrder(rb, key, ready + count);
+    } else {
+        key->slots[sequence % rb->window] = message;
+        key->pending++;
+    }
+    return count;
+}
+
+int reorderFlushKey(ReorderBuffer* rb, int key, void** ready) {
+    ReorderKey* k = &rb->keys[key];
+    int count = 0;
+    while (k->pending > 0) {
+        void** slot = &k->slots[k->next % rb->window];
+        if (*slot) {
+            ready[count++] = *slot;
+            *slot = NULL;
+            k->pending--;
+        }
+        k->next++;
+    }
+    return count;
+}
+
+void destroyReorderBuffer(ReorderBuffer* rb) {
+    if (rb) {
+        int numKeys = rb->numProducers * rb->numTypes;
+        for (int i = 0; i < numKeys; i++) {
+            free(rb->keys[i].slots);
+        }
+        free(rb->keys);
+        free(rb);
+    }
+}
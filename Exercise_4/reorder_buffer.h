@@ -0,0 +1,31 @@
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+// Restores per-(producer, type) sequence order for messages that parallel co-editors may
+// finish out of order. Each key holds at most 'window' early messages; when a message
+// arrives further ahead than that, the missing ones are given up on (emitted late when
+// they show up) so memory stays bounded.
+typedef struct {
+    int next;         // next sequence number to emit
+    int pending;      // early messages currently held
+    void** slots;     // window entries indexed by sequence % window, allocated on first use
+} ReorderKey;
+
+typedef struct {
+    int numProducers;
+    int numTypes;
+    int window;
+    ReorderKey* keys;  // numProducers * numTypes entries
+} ReorderBuffer;
+
+// Function declarations
+ReorderBuffer* createReorderBuffer(int numProducers, int numTypes, int window);
+// Accepts one message and appends every message now in order to 'ready', which must have
+// room for window + 1 entries. Returns the number appended.
+int reorderSubmit(ReorderBuffer* rb, int producer, int type, int sequence, void* message, void** ready);
+// Appends the held messages of one key in sequence order, ignoring gaps. 'ready' must have
+// room for window entries. Returns the number appended.
+int reorderFlushKey(ReorderBuffer* rb, int key, void** ready);
+void destroyReorderBuffer(ReorderBuffer* rb);
+
+#endif
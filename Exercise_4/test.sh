@@ -297,6 +297,356 @@ else
 fi
 echo ""
 
+# Test 13: Co-Editor Pools
+echo -e "${YELLOW}Test 13: Co-Editor Pools${NC}"
+create_test_config "test12.txt" "PRODUCER 1
+60
+queue size = 5
+
+PRODUCER 2
+60
+queue size = 5
+
+Co-Editors per category = 4
+
+Co-Editor queue size = 8"
+start_time=$(date +%s)
+timeout 20s ./ex3.out test12.txt > test12_output.txt 2>&1
+exit_code=$?
+end_time=$(date +%s)
+if [ $exit_code -eq 0 ]; then
+    total=$(grep -E "^Producer [0-9]+ " test12_output.txt | wc -l)
+    done_count=$(grep -c "^DONE$" test12_output.txt)
+    last_line=$(tail -n 1 test12_output.txt)
+    duration=$((end_time - start_time))
+    # 120 edits of 0.1s on 12 workers should take well under the 4+ seconds of one worker per category
+    if [ $total -eq 120 ] && [ $done_count -eq 1 ] && [ "$last_line" = "DONE" ] && [ $duration -lt 4 ]; then
+        print_result 0 "Co-editor pools process all messages in $duration seconds"
+    else
+        print_result 1 "Co-editor pools failed (Total:$total/120, DONE:$done_count/1, Time:$duration)"
+    fi
+else
+    print_result 1 "Co-editor pools, program timeout or crash"
+fi
+echo ""
+
+# Test 14: Reorder Window Keeps Producer Order
+echo -e "${YELLOW}Test 14: Reorder Window Keeps Producer Order${NC}"
+create_test_config "test13.txt" "PRODUCER 1
+60
+queue size = 5
+
+PRODUCER 2
+60
+queue size = 5
+
+Co-Editors per category = 6
+Reorder window = 16
+
+Co-Editor queue size = 8"
+timeout 20s ./ex3.out test13.txt > test13_output.txt 2>&1
+exit_code=$?
+if [ $exit_code -eq 0 ]; then
+    total=$(grep -E "^Producer [0-9]+ " test13_output.txt | wc -l)
+    # Each producer's messages of each type must appear with sequence numbers 0, 1, 2, ...
+    out_of_order=$(awk '/^Producer/ { key = $2 " " $3; if ($4 != next_seq[key] + 0) bad++; next_seq[key] = $4 + 1 } END { print bad + 0 }' test13_output.txt)
+    if [ $total -eq 120 ] && [ $out_of_order -eq 0 ]; then
+        print_result 0 "Reorder window prints every producer's messages in sequence order"
+    else
+        print_result 1 "Reorder window failed (Total:$total/120, out of order:$out_of_order)"
+    fi
+else
+    print_result 1 "Reorder window, program timeout or crash"
+fi
+sed -i 's/Reorder window = 16/Reorder window = -1000/' test13.txt
+timeout 5s ./ex3.out test13.txt > test13_output.txt 2>&1
+if [ $? -ne 0 ] && grep -q "Reorder window must not be negative" test13_output.txt; then
+    print_result 0 "A negative reorder window is rejected"
+else
+    print_result 1 "A negative reorder window was accepted"
+fi
+echo ""
+
+# Test 15: Statistics Report
+echo -e "${YELLOW}Test 15: Statistics Report${NC}"
+create_test_config "test14.txt" "PRODUCER 1
+50
+queue size = 4
+
+PRODUCER 2
+50
+queue size = 4
+
+Edit time = 0
+
+Co-Editor queue size = 4"
+timeout 10s ./ex3.out test14.txt --stats > test14_output.txt 2> test14_stats.txt
+exit_code=$?
+if [ $exit_code -eq 0 ]; then
+    total=$(grep -E "^Producer [0-9]+ " test14_output.txt | wc -l)
+    if [ $total -eq 100 ] && grep -q '"messages":100,' test14_stats.txt && grep -q '"p999":' test14_stats.txt; then
+        print_result 0 "--stats reports throughput, latency and occupancy on stderr"
+    else
+        print_result 1 "--stats report missing or wrong (Total:$total/100, stats: $(cat test14_stats.txt))"
+    fi
+else
+    print_result 1 "Statistics report, program timeout or crash"
+fi
+echo ""
+
+# Test 16: Many Producers on Few Threads
+echo -e "${YELLOW}Test 16: Many Producers on Few Threads${NC}"
+for i in $(seq 1 2000); do
+    printf "PRODUCER %d\n3\nqueue size = 1\n\n" $i
+done > test15.txt
+printf "Producer threads = 3\nEdit time = 0\n\nCo-Editor queue size = 10\n" >> test15.txt
+timeout 20s ./ex3.out test15.txt --stats > test15_output.txt 2> test15_stats.txt
+exit_code=$?
+if [ $exit_code -eq 0 ]; then
+    total=$(grep -E "^Producer [0-9]+ " test15_output.txt | wc -l)
+    # Every one of the 2000 producers must show up with exactly its 3 messages
+    complete=$(awk '/^Producer [0-9]+ / {count[$2]++} END {n = 0; for (p in count) if (count[p] == 3) n++; print n}' test15_output.txt)
+    if [ $total -eq 6000 ] && [ $complete -eq 2000 ] && grep -q '"producer_threads":3,' test15_stats.txt; then
+        print_result 0 "2000 producers multiplexed onto 3 threads deliver all messages"
+    else
+        print_result 1 "Multiplexed producers failed (Total:$total/6000, complete producers:$complete/2000)"
+    fi
+else
+    print_result 1 "Many producers, program timeout or crash"
+fi
+echo ""
+
+# Test 17: Mapped Output File
+echo -e "${YELLOW}Test 17: Mapped Output File${NC}"
+create_test_config "test16.txt" "PRODUCER 1
+300
+queue size = 8
+
+PRODUCER 2
+300
+queue size = 8
+
+Edit time = 0
+Output file = test16_mapped.txt
+
+Co-Editor queue size = 8"
+rm -f test16_mapped.txt
+timeout 10s ./ex3.out test16.txt > test16_output.txt 2>&1
+exit_code=$?
+if [ $exit_code -eq 0 ] && [ -f test16_mapped.txt ]; then
+    total=$(grep -E "^Producer [0-9]+ " test16_mapped.txt | wc -l)
+    last_line=$(tail -n 1 test16_mapped.txt)
+    stdout_lines=$(wc -l < test16_output.txt)
+    if [ $total -eq 600 ] && [ "$last_line" = "DONE" ] && [ $stdout_lines -eq 0 ]; then
+        print_result 0 "Output file receives every message and DONE, stdout stays empty"
+    else
+        print_result 1 "Mapped output failed (Total:$total/600, last line:'$last_line', stdout lines:$stdout_lines)"
+    fi
+else
+    print_result 1 "Mapped output, program timeout, crash or missing file"
+fi
+echo ""
+
+# Test 18: Queue Wait Policies
+echo -e "${YELLOW}Test 18: Queue Wait Policies${NC}"
+create_test_config "test17.txt" "PRODUCER 1
+200
+queue size = 4
+
+PRODUCER 2
+200
+queue size = 4
+
+Edit time = 0
+Dispatcher queue wait = spin
+Co-Editor queue wait = spin-then-block
+Wait spin limit = 100
+
+Co-Editor queue size = 4"
+timeout 10s ./ex3.out test17.txt --stats > test17_output.txt 2> test17_stats.txt
+exit_code=$?
+if [ $exit_code -eq 0 ]; then
+    total=$(grep -E "^Producer [0-9]+ " test17_output.txt | wc -l)
+    if [ $total -eq 400 ] && grep -q '"name":"dispatcher_SPORTS","size":100,"mode":"spsc","wait":"spin"' test17_stats.txt && \
+       grep -q '"name":"coeditor","size":4,"mode":"mpmc","wait":"spin-then-block"' test17_stats.txt; then
+        print_result 0 "Spinning wait policies deliver every message"
+    else
+        print_result 1 "Wait policies failed (Total:$total/400)"
+    fi
+else
+    print_result 1 "Wait policies, program timeout or crash"
+fi
+echo "Dispatcher queue wait = nap" >> test17.txt
+if ./ex3.out test17.txt 2>&1 | grep -q "Unknown wait policy"; then
+    print_result 0 "Unknown wait policy is rejected"
+else
+    print_result 1 "Unknown wait policy was accepted"
+fi
+echo ""
+
+# Test 19: Dispatcher Backpressure
+echo -e "${YELLOW}Test 19: Dispatcher Backpressure${NC}"
+for policy in skip spill; do
+    create_test_config "test18.txt" "PRODUCER 1
+200
+queue size = 5
+
+PRODUCER 2
+200
+queue size = 5
+
+PRODUCER 3
+200
+queue size = 5
+
+Edit time = 0
+SPORTS edit time = 5000
+Dispatcher queue size = 4
+Dispatcher backpressure = $policy
+
+Co-Editor queue size = 8"
+    timeout 20s ./ex3.out test18.txt > test18_output.txt 2>&1
+    exit_code=$?
+    if [ $exit_code -eq 0 ]; then
+        total=$(grep -E "^Producer [0-9]+ " test18_output.txt | wc -l)
+        # With one co-editor per category each producer's stories of a category stay in order
+        out_of_order=$(awk '/^Producer [0-9]+ / {key = $2 " " $3; if (key in last && $4 <= last[key]) bad++; last[key] = $4} END {print bad + 0}' test18_output.txt)
+        # How many slow SPORTS stories were printed before the last NEWS/WEATHER story
+        sports_first=$(awk '/^Producer [0-9]+ / {if ($3 == "SPORTS") sports++; else before = sports} END {print before + 0}' test18_output.txt)
+        if [ $total -eq 600 ] && [ $out_of_order -eq 0 ] && [ $sports_first -lt 50 ]; then
+            print_result 0 "Backpressure $policy keeps order, fast categories done after $sports_first SPORTS stories"
+        else
+            print_result 1 "Backpressure $policy failed (Total:$total/600, out of order:$out_of_order, SPORTS first:$sports_first)"
+        fi
+    else
+        print_result 1 "Backpressure $policy, program timeout or crash"
+    fi
+done
+echo ""
+
+# Test 20: Sharded Dispatchers
+echo -e "${YELLOW}Test 20: Sharded Dispatchers${NC}"
+for policy in block spill; do
+    for i in $(seq 1 50); do
+        printf "PRODUCER %d\n40\nqueue size = 2\n\n" $i
+    done > test19.txt
+    printf "Producer threads = 5\nDispatcher threads = 4\nDispatcher backpressure = %s\nEdit time = 0\n\nCo-Editor queue size = 10\n" $policy >> test19.txt
+    timeout 20s ./ex3.out test19.txt --stats > test19_output.txt 2> test19_stats.txt
+    exit_code=$?
+    if [ $exit_code -eq 0 ]; then
+        total=$(grep -E "^Producer [0-9]+ " test19_output.txt | wc -l)
+        out_of_order=$(awk '/^Producer [0-9]+ / {key = $2 " " $3; if (key in last && $4 <= last[key]) bad++; last[key] = $4} END {print bad + 0}' test19_output.txt)
+        done_lines=$(grep -c "^DONE$" test19_output.txt)
+        if [ $total -eq 2000 ] && [ $out_of_order -eq 0 ] && [ $done_lines -eq 1 ] && grep -q '"dispatcher_threads":4,' test19_stats.txt; then
+            print_result 0 "4 dispatcher shards ($policy) deliver every message in order with one DONE"
+        else
+            print_result 1 "Sharded dispatchers ($policy) failed (Total:$total/2000, out of order:$out_of_order, DONE lines:$done_lines)"
+        fi
+    else
+        print_result 1 "Sharded dispatchers ($policy), program timeout or crash"
+    fi
+done
+echo ""
+
+# Test 21: Thread Placement
+echo -e "${YELLOW}Test 21: Thread Placement${NC}"
+create_test_config "test20.txt" "PRODUCER 1
+200
+queue size = 4
+
+PRODUCER 2
+200
+queue size = 4
+
+Edit time = 0
+Producer cores = 0
+Dispatcher cores = 0
+Co-Editor cores = 0-0
+Screen Manager cores = 0
+
+Co-Editor queue size = 8"
+timeout 10s ./ex3.out test20.txt --stats > test20_output.txt 2> test20_stats.txt
+exit_code=$?
+total=$(grep -E "^Producer [0-9]+ " test20_output.txt | wc -l)
+if [ $exit_code -eq 0 ] && [ $total -eq 400 ] && grep -q '"screen":{"cores":"0",' test20_stats.txt; then
+    print_result 0 "Pinned stages deliver every message and report their cores"
+else
+    print_result 1 "Thread placement failed (exit:$exit_code, Total:$total/400)"
+fi
+sed -i 's/Co-Editor cores = 0-0/Co-Editor cores = 0-100000/' test20.txt
+timeout 5s ./ex3.out test20.txt > test20_output.txt 2>&1
+if [ $? -ne 0 ] && grep -q "Invalid or unavailable cores" test20_output.txt; then
+    print_result 0 "Unavailable cores are rejected"
+else
+    print_result 1 "Unavailable cores were accepted"
+fi
+echo ""
+
+# Test 22: Cancellation
+echo -e "${YELLOW}Test 22: Cancellation${NC}"
+create_test_config "test21.txt" "PRODUCER 1
+100000
+queue size = 5
+
+PRODUCER 2
+100000
+queue size = 5
+
+Edit time = 1000
+
+Co-Editor queue size = 10"
+./ex3.out test21.txt > test21_output.txt 2>&1 &
+pid=$!
+sleep 0.5
+kill -INT $pid
+timeout 10s tail --pid=$pid -f /dev/null
+wait $pid
+exit_code=$?
+total=$(grep -E "^Producer [0-9]+ " test21_output.txt | wc -l)
+last_line=$(tail -n 1 test21_output.txt)
+out_of_order=$(awk '/^Producer [0-9]+ / {key = $2 " " $3; if (key in last && $4 != last[key] + 1) bad++; last[key] = $4} END {print bad + 0}' test21_output.txt)
+if [ $exit_code -eq 130 ] && [ "$last_line" = "DONE" ] && [ $total -gt 0 ] && [ $total -lt 200000 ] && [ $out_of_order -eq 0 ]; then
+    print_result 0 "SIGINT drains the pipeline: $total stories, no gaps, then DONE"
+else
+    print_result 1 "Cancellation failed (exit:$exit_code, Total:$total, last line:'$last_line', gaps:$out_of_order)"
+fi
+echo ""
+
+# Test 23: Occupancy Never Exceeds Capacity
+echo -e "${YELLOW}Test 23: Occupancy Never Exceeds Capacity${NC}"
+create_test_config "test23.txt" "PRODUCER 1
+5000
+queue size = 16
+
+PRODUCER 2
+5000
+queue size = 16
+
+PRODUCER 3
+5000
+queue size = 16
+
+PRODUCER 4
+5000
+queue size = 16
+
+Dispatcher queue size = 100
+Edit time = 0
+
+Co-Editor queue size = 16"
+timeout 20s ./ex3.out test23.txt --stats > test23_output.txt 2> test23_stats.txt
+exit_code=$?
+producer_max=$(grep -o '"producer":{"avg":[0-9.]*,"max":[0-9]*' test23_stats.txt | grep -o '[0-9]*$')
+dispatcher_max=$(grep -o '"dispatcher":{"avg":[0-9.]*,"max":[0-9]*' test23_stats.txt | grep -o '[0-9]*$')
+coeditor_max=$(grep -o '"coeditor":{"avg":[0-9.]*,"max":[0-9]*' test23_stats.txt | grep -o '[0-9]*$')
+if [ $exit_code -eq 0 ] && [ -n "$producer_max" ] && [ -n "$dispatcher_max" ] && [ -n "$coeditor_max" ] &&
+   [ "$producer_max" -le 16 ] && [ "$dispatcher_max" -le 100 ] && [ "$coeditor_max" -le 16 ]; then
+    print_result 0 "Reported max occupancy stays within capacity ($producer_max/16, $dispatcher_max/100, $coeditor_max/16)"
+else
+    print_result 1 "Occupancy above capacity or missing (exit:$exit_code, producer:$producer_max/16, dispatcher:$dispatcher_max/100, coeditor:$coeditor_max/16)"
+fi
+echo ""
+
 # Summary
 echo -e "${BLUE}=== Test Summary ===${NC}"
 echo -e "Tests Passed: ${GREEN}$TESTS_PASSED${NC}"